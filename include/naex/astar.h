@@ -0,0 +1,124 @@
+#ifndef NAEX_ASTAR_H
+#define NAEX_ASTAR_H
+
+#include <cmath>
+#include <limits>
+#include <naex/map.h>
+#include <naex/radix_heap.h>
+#include <naex/search_workspace.h>
+#include <naex/types.h>
+#include <utility>
+#include <vector>
+
+namespace naex
+{
+
+/**
+ * A* search for a path between two vertices of the map graph.
+ *
+ * Uses Euclidean distance to the goal vertex as the heuristic, which is
+ * consistent since edge costs are never lower than edge lengths.
+ * If the goal cannot be reached, the whole component of the source is
+ * expanded and the expanded vertex closest to the goal position is returned,
+ * as with a full Dijkstra search.
+ *
+ * Path costs and predecessors are kept in a workspace, which starts each
+ * search in constant time, so that the search does not scale with map size.
+ */
+class AStar
+{
+public:
+    typedef RadixHeap<Vertex> Queue;
+
+    explicit AStar(SearchWorkspace& workspace):
+        workspace_(workspace)
+    {}
+
+    /** Path costs and predecessors from source, valid until another search uses the workspace. */
+    const SearchWorkspace& workspace() const
+    {
+        return workspace_;
+    }
+
+    /** Number of vertices expanded in the last search. */
+    size_t num_expanded() const
+    {
+        return num_expanded_;
+    }
+
+    /**
+     * Search path from source to goal.
+     * @return Goal if reached, otherwise the expanded vertex closest to the goal position.
+     */
+    Vertex search(const Map& map, Vertex source, Vertex goal, const Vec3& goal_position)
+    {
+        return search(map, source, goal, goal_position, [](Vertex) { return true; });
+    }
+
+    /**
+     * Search path from source to goal through allowed vertices only,
+     * e.g., within a corridor around a coarse path.
+     * @return Goal if reached, otherwise the expanded vertex closest to the goal position.
+     */
+    template<typename F>
+    Vertex search(const Map& map, Vertex source, Vertex goal, const Vec3& goal_position, F allowed)
+    {
+        workspace_.reset(size_t(map.num_vertices()));
+        num_expanded_ = 0;
+        const Vec3 goal_vertex_position = ConstVec3Map(map.cloud_[goal].position_);
+        const auto heuristic = [&](Vertex v)
+        {
+            return (ConstVec3Map(map.cloud_[v].position_) - goal_vertex_position).norm();
+        };
+
+        Vertex closest = INVALID_VERTEX;
+        Value closest_dist = std::numeric_limits<Value>::infinity();
+        Queue queue;
+        workspace_.set(source, 0, source);
+        queue.emplace(heuristic(source), source);
+        while (!queue.empty())
+        {
+            const auto item = queue.top();
+            queue.pop();
+            const auto u = item.second;
+            // Skip outdated entries.
+            const Value cost_u = workspace_.path_cost(u);
+            if (item.first > cost_u + heuristic(u))
+            {
+                continue;
+            }
+            ++num_expanded_;
+            if (u == goal)
+            {
+                return goal;
+            }
+            const Value dist = (ConstVec3Map(map.cloud_[u].position_) - goal_position).norm();
+            if (dist < closest_dist)
+            {
+                closest = u;
+                closest_dist = dist;
+            }
+            const auto edges = map.out_edges(u);
+            for (Edge e = *edges.first; e != *edges.second; ++e)
+            {
+                const auto v = map.target(e);
+                const Value cost = cost_u + map.edge_cost(e);
+                if (!(cost < workspace_.path_cost(v)) || !allowed(v))
+                {
+                    continue;
+                }
+                workspace_.set(v, cost, u);
+                queue.emplace(cost + heuristic(v), v);
+            }
+        }
+        return closest;
+    }
+
+private:
+    SearchWorkspace& workspace_;
+    size_t num_expanded_{0};
+};
+
+}  // namespace naex
+
+#endif  // NAEX_ASTAR_H
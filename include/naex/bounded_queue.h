@@ -0,0 +1,124 @@
+#ifndef NAEX_BOUNDED_QUEUE_H
+#define NAEX_BOUNDED_QUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace naex
+{
+
+/**
+ * Bounded FIFO queue connecting pipeline stages running on separate threads.
+ *
+ * Producers never block: once the queue is full, the oldest item is dropped
+ * to make room, so that a slow stage always continues with the most recent
+ * data. Consumers block until an item is available or the queue is closed.
+ */
+template<typename T>
+class BoundedQueue
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit BoundedQueue(size_t capacity):
+        capacity_(capacity > 0 ? capacity : 1)
+    {}
+
+    /**
+     * Push item, dropping the oldest one if full.
+     * @return Whether an item was dropped.
+     */
+    bool push(T item)
+    {
+        bool dropped = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_)
+            {
+                return false;
+            }
+            if (items_.size() >= capacity_)
+            {
+                items_.pop_front();
+                ++num_dropped_;
+                dropped = true;
+            }
+            items_.push_back(std::move(item));
+        }
+        not_empty_.notify_one();
+        return dropped;
+    }
+
+    /**
+     * Pop the oldest item, waiting until one is available.
+     * @return False if the queue was closed.
+     */
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        return pop_locked(item);
+    }
+
+    /**
+     * Pop the oldest item, waiting until one is available or deadline passes.
+     * @return False on timeout or if the queue was closed.
+     */
+    bool pop_until(T& item, const Clock::time_point& deadline)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait_until(lock, deadline, [this] { return closed_ || !items_.empty(); });
+        return pop_locked(item);
+    }
+
+    /** Wake up all consumers and reject further items. */
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            items_.clear();
+        }
+        not_empty_.notify_all();
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return items_.size();
+    }
+
+    /** Number of items dropped so far. */
+    size_t num_dropped() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return num_dropped_;
+    }
+
+private:
+    bool pop_locked(T& item)
+    {
+        if (closed_ || items_.empty())
+        {
+            return false;
+        }
+        item = std::move(items_.front());
+        items_.pop_front();
+        return true;
+    }
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_{};
+    size_t num_dropped_{0};
+    bool closed_{false};
+};
+
+}  // namespace naex
+
+#endif  // NAEX_BOUNDED_QUEUE_H
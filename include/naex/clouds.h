@@ -2,6 +2,7 @@
 #ifndef NAEX_CLOUDS_H
 #define NAEX_CLOUDS_H
 
+#include <algorithm>
 #include <cmath>
 #include <iomanip>
 #include <iostream>
@@ -567,6 +568,209 @@ size_t num_points(const sensor_msgs::PointCloud2& cloud)
             }
         }
 
+        /**
+         * Tabulate fractional rows per elevation bin, following mean
+         * elevations of cloud rows, as beam elevations of multi-beam lidars
+         * are often not uniform. Rows without valid points follow the model.
+         * @return Whether rows are monotonic and the table was created.
+         */
+        bool tabulate_rows(const sensor_msgs::PointCloud2& cloud, int bins_per_row = 4)
+        {
+            Timer t;
+            rows_.clear();
+            if (cloud.height != height_ || cloud.width != width_ || height_ < 2)
+            {
+                return false;
+            }
+            std::vector<double> sums(height_, 0.);
+            std::vector<Index> counts(height_, 0);
+            sensor_msgs::PointCloud2ConstIterator<float> x_it(cloud, "x");
+            for (Index r = 0; r < height_; ++r)
+            {
+                for (Index c = 0; c < width_; ++c, ++x_it)
+                {
+                    if (!std::isfinite(x_it[0]) || !std::isfinite(x_it[1]) || !std::isfinite(x_it[2]))
+                        continue;
+                    sums[r] += elevation(x_it[0], x_it[1], x_it[2]);
+                    ++counts[r];
+                }
+            }
+            // Row elevations in ascending order.
+            std::vector<std::pair<Value, Value>> rows;
+            rows.reserve(height_);
+            for (Index r = 0; r < height_; ++r)
+            {
+                const Value el = counts[r] > 0
+                                 ? Value(sums[r] / counts[r])
+                                 : elevation_start_ + r * elevation_step_;
+                rows.emplace_back(el, Value(r));
+            }
+            if (elevation_step_ < 0)
+            {
+                std::reverse(rows.begin(), rows.end());
+            }
+            for (size_t k = 1; k < rows.size(); ++k)
+            {
+                if (!(rows[k].first > rows[k - 1].first))
+                {
+                    ROS_WARN("Row elevations not monotonic, using linear model.");
+                    return false;
+                }
+            }
+
+            const Value step = std::abs(elevation_step_);
+            elevation_lower_ = rows.front().first - step / 2;
+            elevation_upper_ = rows.back().first + step / 2;
+            elevation_min_ = rows.front().first - step;
+            bins_per_radian_ = bins_per_row / step;
+            const size_t n_bins = size_t((rows.back().first + step - elevation_min_) * bins_per_radian_) + 2;
+            rows_.resize(n_bins);
+            size_t k = 0;
+            for (size_t i = 0; i < n_bins; ++i)
+            {
+                const Value el = elevation_min_ + i / bins_per_radian_;
+                while (k + 2 < rows.size() && el > rows[k + 1].first)
+                {
+                    ++k;
+                }
+                // Interpolate between neighboring rows, extrapolate at ends.
+                const auto& a = rows[k];
+                const auto& b = rows[k + 1];
+                rows_[i] = a.second + (el - a.first) / (b.first - a.first) * (b.second - a.second);
+            }
+            ROS_DEBUG("Rows tabulated in %lu elevation bins (%.6f s).", n_bins, t.seconds_elapsed());
+            return true;
+        }
+
+        /** Fractional row of given elevation, using tabulated rows if available. */
+        template<typename T>
+        T row(const T elevation) const
+        {
+            const T k = (elevation - elevation_min_) * bins_per_radian_;
+            if (!(k >= 0 && k + 1 < rows_.size()))
+            {
+                return (elevation - elevation_start_) / elevation_step_;
+            }
+            const size_t i = size_t(k);
+            return rows_[i] + (k - i) * (rows_[i + 1] - rows_[i]);
+        }
+
+        /** Fractional column of given azimuth. */
+        template<typename T>
+        T column(const T azimuth) const
+        {
+            return (azimuth - azimuth_start_) / azimuth_step_;
+        }
+
+        /**
+         * Project point to fractional row and column, using tabulated rows
+         * if available, otherwise the linear model.
+         */
+        template<typename T>
+        void lookup(const T x, const T y, const T z, T& r, T& c) const
+        {
+            c = column(std::atan2(y, x));
+            r = row(fast_inclination(x, y, z));
+        }
+
+        /** Elevation interval covered by rows, including half a row around. */
+        void elevation_bounds(Value& lower, Value& upper) const
+        {
+            if (!rows_.empty())
+            {
+                lower = elevation_lower_;
+                upper = elevation_upper_;
+                return;
+            }
+            const Value a = elevation_start_ - elevation_step_ / 2;
+            const Value b = elevation_start_ + (Value(height_) - Value(0.5)) * elevation_step_;
+            lower = std::min(a, b);
+            upper = std::max(a, b);
+        }
+
+        /** Azimuth interval covered by columns, as its center and half width. */
+        void azimuth_bounds(Value& center, Value& half_width) const
+        {
+            center = azimuth_start_ + (Value(width_) - 1) / 2 * azimuth_step_;
+            half_width = std::min(Value(width_) * std::abs(azimuth_step_) / 2, Value(M_PI));
+        }
+
+        /** Whether point in sensor frame is within range and angular bounds. */
+        bool contains(Value x, Value y, Value z, Value range) const
+        {
+            if (!(x * x + y * y + z * z <= range * range))
+            {
+                return false;
+            }
+            Value lower, upper, center, half_width;
+            elevation_bounds(lower, upper);
+            azimuth_bounds(center, half_width);
+            const Value elevation = fast_inclination(x, y, z);
+            if (!(elevation >= lower && elevation <= upper))
+            {
+                return false;
+            }
+            return half_width >= Value(M_PI)
+                || std::abs(wrap_angle(std::atan2(y, x) - center)) <= half_width;
+        }
+
+        enum Containment
+        {
+            OUTSIDE,
+            CROSSING,
+            INSIDE
+        };
+
+        /**
+         * Classify a ball in sensor frame against range and angular bounds,
+         * so that whole voxels can be culled or accepted at once.
+         * The classification is conservative, balls may be crossing
+         * even though they are inside or outside.
+         */
+        Containment classify(const Vec3& center, Value radius, Value range) const
+        {
+            const Value dist = center.norm();
+            if (dist - radius > range)
+            {
+                return OUTSIDE;
+            }
+            if (!(dist > radius))
+            {
+                return CROSSING;
+            }
+            const bool within_range = dist + radius <= range;
+            // Angular radius of the ball.
+            const Value sin_a = radius / dist;
+            const Value a = std::asin(sin_a);
+            Value lower, upper;
+            elevation_bounds(lower, upper);
+            const Value elevation = fast_inclination(center(0), center(1), center(2));
+            if (elevation + a < lower || elevation - a > upper)
+            {
+                return OUTSIDE;
+            }
+            const bool within_elevation = elevation - a >= lower && elevation + a <= upper;
+            Value mid, half_width;
+            azimuth_bounds(mid, half_width);
+            if (half_width >= Value(M_PI))
+            {
+                return within_range && within_elevation ? INSIDE : CROSSING;
+            }
+            // Azimuth extent is not bounded if the ball contains the z axis.
+            const Value cos_el = std::cos(elevation);
+            if (!(sin_a < cos_el))
+            {
+                return CROSSING;
+            }
+            const Value da = std::asin(sin_a / cos_el);
+            const Value delta = std::abs(wrap_angle(std::atan2(center(1), center(0)) - mid));
+            if (delta - da > half_width)
+            {
+                return OUTSIDE;
+            }
+            return within_range && within_elevation && delta + da <= half_width ? INSIDE : CROSSING;
+        }
+
         // Azimuth, angle in xy plane, positive for x to y direction;
         // azimuth at image[:, 0].
         float azimuth_start_;
@@ -578,6 +782,13 @@ size_t num_points(const sensor_msgs::PointCloud2& cloud)
         // Cloud 2D grid size.
         uint32_t height_;
         uint32_t width_;
+        // Fractional rows per elevation bin, empty for linear model.
+        std::vector<Value> rows_{};
+        Value elevation_min_{0};
+        Value bins_per_radian_{0};
+        // Elevations covered by tabulated rows.
+        Value elevation_lower_{0};
+        Value elevation_upper_{0};
     };
 
 void copy_cloud_metadata(const sensor_msgs::PointCloud2& input,
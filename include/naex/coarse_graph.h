@@ -0,0 +1,328 @@
+#ifndef NAEX_COARSE_GRAPH_H
+#define NAEX_COARSE_GRAPH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <naex/radix_heap.h>
+#include <naex/timer.h>
+#include <naex/types.h>
+#include <naex/voxel_filter.h>
+#include <ros/ros.h>
+#include <vector>
+
+namespace naex
+{
+
+/**
+ * Coarse graph of voxel super-nodes over traversable map points,
+ * for planning long paths before refining them in the fine graph.
+ *
+ * Each traversable point belongs to the node of its voxel. Nodes are
+ * connected if any valid fine edge crosses between their members, with cost
+ * per meter averaged over the crossing edges. Node positions are the members
+ * closest to voxel centroids, so that Euclidean distance stays an admissible
+ * heuristic for coarse search as fine edge costs are never below edge lengths.
+ *
+ * Nodes affected by updated points are rebuilt incrementally. Nodes are never
+ * removed, emptied nodes lose all their edges.
+ */
+class CoarseGraph
+{
+public:
+    typedef Voxel<int> Key;
+    typedef int Node;
+    enum { INVALID_NODE = -1 };
+
+    struct CoarseEdge
+    {
+        Node target;
+        // Mean cost per meter of fine edges crossing to the target.
+        Value cost_ratio;
+    };
+
+    struct NodeData
+    {
+        Key voxel{};
+        std::vector<Vertex> members{};
+        // Member closest to the centroid.
+        Vertex representative{INVALID_VERTEX};
+        Vec3 position{Vec3::Zero()};
+        std::vector<CoarseEdge> edges{};
+    };
+
+    void clear()
+    {
+        index_.clear();
+        nodes_.clear();
+        node_of_.clear();
+        touched_.clear();
+    }
+
+    size_t num_nodes() const
+    {
+        return nodes_.size();
+    }
+
+    const NodeData& node(Node i) const
+    {
+        return nodes_[i];
+    }
+
+    /** Node of vertex v, invalid for non-traversable or unknown vertices. */
+    Node node_of(Vertex v) const
+    {
+        return size_t(v) < node_of_.size() ? node_of_[v] : INVALID_NODE;
+    }
+
+    /** Cost of coarse edge from node a. */
+    Value edge_cost(Node a, const CoarseEdge& e) const
+    {
+        return e.cost_ratio * (nodes_[e.target].position - nodes_[a].position).norm();
+    }
+
+    /**
+     * Reassign changed vertices to nodes and rebuild affected nodes,
+     * including nodes of their neighbors as their edges change too.
+     * @return Number of nodes rebuilt.
+     */
+    template<typename M>
+    size_t update(const M& map, const std::vector<Index>& changed, Value voxel_size)
+    {
+        Timer t;
+        node_of_.resize(size_t(map.num_vertices()), INVALID_NODE);
+        std::vector<Node> touched;
+        for (const auto v: changed)
+        {
+            if (size_t(v) >= node_of_.size())
+            {
+                continue;
+            }
+            Node i = INVALID_NODE;
+            Key voxel;
+            const auto flags = map.cloud_[v].flags_;
+            if ((flags & STATIC) && (flags & TRAVERSABLE) && voxel.from(map.position(v), voxel_size))
+            {
+                i = find_or_add(voxel);
+            }
+            if (i != node_of_[v])
+            {
+                touch(node_of_[v], touched);
+                node_of_[v] = i;
+                if (i != INVALID_NODE)
+                {
+                    nodes_[i].members.push_back(v);
+                }
+            }
+            touch(i, touched);
+            const auto edges = map.out_edges(v);
+            for (Edge e = *edges.first; e != *edges.second; ++e)
+            {
+                touch(node_of(map.target(e)), touched);
+            }
+        }
+        for (const auto i: touched)
+        {
+            touched_[i] = 0;
+            rebuild(map, i);
+        }
+        ROS_DEBUG("Coarse graph: %lu / %lu nodes rebuilt (%.3f s).",
+                  touched.size(), nodes_.size(), t.seconds_elapsed());
+        return touched.size();
+    }
+
+    /**
+     * A* search for node path from source to goal.
+     * @return Whether the goal was reached.
+     */
+    bool search(Node source, Node goal, std::vector<Node>& path) const
+    {
+        path.clear();
+        if (source == INVALID_NODE || goal == INVALID_NODE)
+        {
+            return false;
+        }
+        const auto heuristic = [&](Node i)
+        {
+            return (nodes_[i].position - nodes_[goal].position).norm();
+        };
+        std::vector<Value> path_costs(nodes_.size(), std::numeric_limits<Value>::infinity());
+        std::vector<Node> predecessors(nodes_.size(), INVALID_NODE);
+        BinaryHeap<Node> queue;
+        path_costs[source] = 0;
+        predecessors[source] = source;
+        queue.emplace(heuristic(source), source);
+        while (!queue.empty())
+        {
+            const auto item = queue.top();
+            queue.pop();
+            const auto a = item.second;
+            // Skip outdated entries.
+            if (item.first > path_costs[a] + heuristic(a))
+            {
+                continue;
+            }
+            if (a == goal)
+            {
+                break;
+            }
+            for (const auto& e: nodes_[a].edges)
+            {
+                const Value cost = path_costs[a] + edge_cost(a, e);
+                if (cost < path_costs[e.target])
+                {
+                    path_costs[e.target] = cost;
+                    predecessors[e.target] = a;
+                    queue.emplace(cost + heuristic(e.target), e.target);
+                }
+            }
+        }
+        if (predecessors[goal] == INVALID_NODE)
+        {
+            return false;
+        }
+        for (Node i = goal; i != source; i = predecessors[i])
+        {
+            path.push_back(i);
+        }
+        path.push_back(source);
+        std::reverse(path.begin(), path.end());
+        return true;
+    }
+
+    /** Mask of nodes on the path and their neighbors up to given number of hops. */
+    std::vector<uint8_t> corridor(const std::vector<Node>& path, int hops = 1) const
+    {
+        std::vector<uint8_t> mask(nodes_.size(), 0);
+        std::vector<Node> layer;
+        for (const auto i: path)
+        {
+            mask[i] = 1;
+            layer.push_back(i);
+        }
+        for (int k = 0; k < hops; ++k)
+        {
+            std::vector<Node> next;
+            for (const auto i: layer)
+            {
+                for (const auto& e: nodes_[i].edges)
+                {
+                    if (!mask[e.target])
+                    {
+                        mask[e.target] = 1;
+                        next.push_back(e.target);
+                    }
+                }
+            }
+            layer.swap(next);
+        }
+        return mask;
+    }
+
+private:
+    Node find_or_add(const Key& voxel)
+    {
+        const auto it = index_.find(voxel);
+        if (it != index_.end())
+        {
+            return it->second;
+        }
+        const Node i = Node(nodes_.size());
+        index_.emplace(voxel, i);
+        nodes_.emplace_back();
+        nodes_.back().voxel = voxel;
+        touched_.push_back(0);
+        return i;
+    }
+
+    void touch(Node i, std::vector<Node>& touched)
+    {
+        if (i != INVALID_NODE && !touched_[i])
+        {
+            touched_[i] = 1;
+            touched.push_back(i);
+        }
+    }
+
+    template<typename M>
+    void rebuild(const M& map, Node i)
+    {
+        auto& node = nodes_[i];
+        // Drop members which moved away, or were listed again on return.
+        auto& members = node.members;
+        members.erase(std::remove_if(members.begin(), members.end(),
+                                     [&](Vertex v) { return node_of_[v] != i; }),
+                      members.end());
+        std::sort(members.begin(), members.end());
+        members.erase(std::unique(members.begin(), members.end()), members.end());
+        node.edges.clear();
+        node.representative = INVALID_VERTEX;
+        if (members.empty())
+        {
+            return;
+        }
+
+        Vec3 centroid = Vec3::Zero();
+        for (const auto v: members)
+        {
+            centroid += ConstVec3Map(map.position(v));
+        }
+        centroid /= Value(members.size());
+        Value min_dist = std::numeric_limits<Value>::infinity();
+        for (const auto v: members)
+        {
+            const Value dist = (ConstVec3Map(map.position(v)) - centroid).squaredNorm();
+            if (dist < min_dist)
+            {
+                min_dist = dist;
+                node.representative = v;
+            }
+        }
+        node.position = ConstVec3Map(map.position(node.representative));
+
+        // Sum cost ratios of crossing edges, few neighbor nodes are expected.
+        std::vector<int> counts;
+        for (const auto v: members)
+        {
+            const auto edges = map.out_edges(v);
+            for (Edge e = *edges.first; e != *edges.second; ++e)
+            {
+                const auto j = node_of(map.target(e));
+                const Value cost = map.edge_cost(e);
+                const Value dist = map.graph_.distances_[e];
+                if (j == INVALID_NODE || j == i || !std::isfinite(cost) || !(dist > 0))
+                {
+                    continue;
+                }
+                size_t k = 0;
+                while (k < node.edges.size() && node.edges[k].target != j)
+                {
+                    ++k;
+                }
+                if (k == node.edges.size())
+                {
+                    node.edges.push_back({j, 0});
+                    counts.push_back(0);
+                }
+                node.edges[k].cost_ratio += cost / dist;
+                ++counts[k];
+            }
+        }
+        for (size_t k = 0; k < node.edges.size(); ++k)
+        {
+            node.edges[k].cost_ratio /= Value(counts[k]);
+        }
+    }
+
+    VoxelMap<int, Node> index_{};
+    std::vector<NodeData> nodes_{};
+    // Node of each vertex.
+    std::vector<Node> node_of_{};
+    // Marks of nodes touched in update, kept clear between updates.
+    std::vector<uint8_t> touched_{};
+};
+
+}  // namespace naex
+
+#endif  // NAEX_COARSE_GRAPH_H
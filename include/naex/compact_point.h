@@ -0,0 +1,387 @@
+#ifndef NAEX_COMPACT_POINT_H
+#define NAEX_COMPACT_POINT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <naex/quantization.h>
+#include <naex/types.h>
+#include <type_traits>
+#include <vector>
+
+namespace naex
+{
+
+/**
+ * Fixed-point value with range [-Num / Den, Num / Den] for signed,
+ * or [0, Num / Den] for unsigned integer types.
+ *
+ * NaN and infinities are stored as reserved codes, as the map uses them
+ * to mark missing data, finite values beyond the range saturate.
+ *
+ * @tparam I Integer storage type.
+ * @tparam Num Scale numerator.
+ * @tparam Den Scale denominator.
+ */
+template<typename I, int Num, int Den = 1>
+class Quantized
+{
+public:
+    typedef Quantized<I, Num, Den> Same;
+
+    static Value scale()
+    {
+        return Value(Num) / Value(Den);
+    }
+    static constexpr I nan_code()
+    {
+        return std::is_signed<I>::value ? std::numeric_limits<I>::min() : std::numeric_limits<I>::max();
+    }
+    static constexpr I inf_code()
+    {
+        return std::is_signed<I>::value ? std::numeric_limits<I>::max() : I(std::numeric_limits<I>::max() - 1);
+    }
+    static constexpr I neg_inf_code()
+    {
+        return std::is_signed<I>::value ? I(-inf_code()) : I(0);
+    }
+    static constexpr I max_code()
+    {
+        return I(inf_code() - 1);
+    }
+    static constexpr I min_code()
+    {
+        return std::is_signed<I>::value ? I(-max_code()) : I(0);
+    }
+
+    Quantized()
+    {}
+    Quantized(Value value)
+    {
+        *this = value;
+    }
+
+    Same& operator=(Value value)
+    {
+        if (std::isnan(value))
+        {
+            code_ = nan_code();
+            return *this;
+        }
+        if (std::isinf(value))
+        {
+            code_ = value > 0 ? inf_code() : neg_inf_code();
+            return *this;
+        }
+        I code = quantize<Value, I>(value, scale());
+        code_ = (code < min_code()) ? min_code() : (code > max_code()) ? max_code() : code;
+        return *this;
+    }
+
+    operator Value() const
+    {
+        if (code_ == nan_code())
+        {
+            return std::numeric_limits<Value>::quiet_NaN();
+        }
+        if (code_ == inf_code())
+        {
+            return std::numeric_limits<Value>::infinity();
+        }
+        if (std::is_signed<I>::value && code_ == neg_inf_code())
+        {
+            return -std::numeric_limits<Value>::infinity();
+        }
+        return reconstruct<Value, I>(code_, scale());
+    }
+
+    I code_{nan_code()};
+};
+
+/**
+ * Unit vector stored as octahedral projection in two int16 values.
+ * https://jcgt.org/published/0003/02/01/
+ */
+class OctNormal
+{
+public:
+    typedef int16_t I;
+
+    static constexpr I nan_code()
+    {
+        return std::numeric_limits<I>::min();
+    }
+
+    OctNormal()
+    {}
+    OctNormal(const Vec3& n)
+    {
+        encode(n);
+    }
+
+    void encode(const Vec3& n)
+    {
+        const Value l1 = std::abs(n(0)) + std::abs(n(1)) + std::abs(n(2));
+        if (!std::isfinite(l1) || l1 == 0)
+        {
+            uv_[0] = uv_[1] = nan_code();
+            return;
+        }
+        Value u = n(0) / l1;
+        Value v = n(1) / l1;
+        if (n(2) < 0)
+        {
+            const Value u0 = u;
+            u = (1 - std::abs(v)) * sign(u0);
+            v = (1 - std::abs(u0)) * sign(v);
+        }
+        uv_[0] = std::max(I(-std::numeric_limits<I>::max()), quantize<Value, I>(u, Value(1)));
+        uv_[1] = std::max(I(-std::numeric_limits<I>::max()), quantize<Value, I>(v, Value(1)));
+    }
+
+    Vec3 decode() const
+    {
+        if (uv_[0] == nan_code())
+        {
+            return Vec3::Constant(std::numeric_limits<Value>::quiet_NaN());
+        }
+        Value u = reconstruct<Value, I>(uv_[0], Value(1));
+        Value v = reconstruct<Value, I>(uv_[1], Value(1));
+        Vec3 n(u, v, 1 - std::abs(u) - std::abs(v));
+        if (n(2) < 0)
+        {
+            n(0) = (1 - std::abs(v)) * sign(u);
+            n(1) = (1 - std::abs(u)) * sign(v);
+        }
+        return n.normalized();
+    }
+
+    I uv_[2] = {nan_code(), nan_code()};
+
+private:
+    static Value sign(Value x)
+    {
+        return x >= 0 ? Value(1) : Value(-1);
+    }
+};
+
+/**
+ * Float stored in its upper 16 bits (bfloat16), keeping the float range,
+ * NaN, and infinities with 8 significant bits, rounded to nearest even.
+ */
+class BFloat16
+{
+public:
+    BFloat16()
+    {}
+    BFloat16(Value value)
+    {
+        *this = value;
+    }
+
+    BFloat16& operator=(Value value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        if (std::isnan(value))
+        {
+            bits_ = uint16_t((bits >> 16) | 0x40);
+            return *this;
+        }
+        bits += 0x7fff + ((bits >> 16) & 1);
+        bits_ = uint16_t(bits >> 16);
+        return *this;
+    }
+
+    operator Value() const
+    {
+        const uint32_t bits = uint32_t(bits_) << 16;
+        Value value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    uint16_t bits_{0x7fc0};
+};
+
+/**
+ * Placeholder of a point field which is not stored, assignments are ignored
+ * and reads give NaN, or zero for integer types.
+ */
+template<typename T>
+class Dropped
+{
+public:
+    const Dropped& operator=(T) const
+    {
+        return *this;
+    }
+    operator T() const
+    {
+        return std::numeric_limits<T>::has_quiet_NaN ? std::numeric_limits<T>::quiet_NaN() : T(0);
+    }
+};
+
+/**
+ * Point fields not stored in CompactPoint, static so that they take no space.
+ * These are only published for inspection, labels and costs use neither.
+ */
+template<typename V>
+class DroppedFields
+{
+public:
+    static const Dropped<uint8_t> normal_support_;
+    static const Dropped<V> min_ground_diff_;
+    static const Dropped<V> max_ground_diff_;
+    static const Dropped<V> mean_abs_ground_diff_;
+    static const Dropped<V> dist_to_plane_;
+    static const Dropped<uint8_t> num_obstacle_pts_;
+    static const Dropped<V> relative_cost_;
+};
+
+template<typename V> const Dropped<uint8_t> DroppedFields<V>::normal_support_{};
+template<typename V> const Dropped<V> DroppedFields<V>::min_ground_diff_{};
+template<typename V> const Dropped<V> DroppedFields<V>::max_ground_diff_{};
+template<typename V> const Dropped<V> DroppedFields<V>::mean_abs_ground_diff_{};
+template<typename V> const Dropped<V> DroppedFields<V>::dist_to_plane_{};
+template<typename V> const Dropped<uint8_t> DroppedFields<V>::num_obstacle_pts_{};
+template<typename V> const Dropped<V> DroppedFields<V>::relative_cost_{};
+
+/**
+ * Compact point representation, a drop-in replacement of Point within Map.
+ *
+ * Normals are stored as octahedral int16 pairs, terrain features, distances,
+ * and coverage as fixed-point integers, visit times as uint16 seconds from
+ * initialization, path costs and rewards as bfloat16, and occupancy and
+ * neighbor counters as bit fields. Fields used only for inspection are
+ * dropped (see DroppedFields), as is the viewpoint. Members keep names of
+ * Point and decode implicitly, normals are accessed via normal() and
+ * set_normal(). The point takes 36 bytes, a third of Point.
+ */
+class CompactPoint: public DroppedFields<Value>
+{
+public:
+    // Max. value of occupancy counters.
+    static const int MAX_OCC_COUNTER = 15;
+
+    CompactPoint():
+        num_empty_(0),
+        num_occupied_(0),
+        num_obstacle_neighbors_(0),
+        num_edge_neighbors_(0)
+    {}
+
+    CompactPoint(const Point& p):
+        CompactPoint()
+    {
+        std::copy(p.position_, p.position_ + 3, position_);
+        set_normal(p.normal());
+        ground_diff_std_ = p.ground_diff_std_;
+        dist_to_actor_ = p.dist_to_actor_;
+        actor_last_visit_ = p.actor_last_visit_;
+        dist_to_other_actors_ = p.dist_to_other_actors_;
+        other_actors_last_visit_ = p.other_actors_last_visit_;
+        coverage_ = p.coverage_;
+        self_coverage_ = p.self_coverage_;
+        dist_to_obstacle_ = p.dist_to_obstacle_;
+        flags_ = p.flags_;
+        num_empty_ = std::min(int(p.num_empty_), int(MAX_OCC_COUNTER));
+        num_occupied_ = std::min(int(p.num_occupied_), int(MAX_OCC_COUNTER));
+        num_obstacle_neighbors_ = p.num_obstacle_neighbors_;
+        num_edge_neighbors_ = p.num_edge_neighbors_;
+        path_cost_ = p.path_cost_;
+        reward_ = p.reward_;
+    }
+
+    /** Decode into a full point, dropped fields are NaN or zero. */
+    operator Point() const
+    {
+        Point p;
+        std::copy(position_, position_ + 3, p.position_);
+        p.set_normal(normal());
+        p.normal_support_ = normal_support_;
+        p.ground_diff_std_ = ground_diff_std_;
+        p.min_ground_diff_ = min_ground_diff_;
+        p.max_ground_diff_ = max_ground_diff_;
+        p.mean_abs_ground_diff_ = mean_abs_ground_diff_;
+        std::fill(p.viewpoint_, p.viewpoint_ + 3, std::numeric_limits<Value>::quiet_NaN());
+        p.dist_to_actor_ = dist_to_actor_;
+        p.actor_last_visit_ = actor_last_visit_;
+        p.dist_to_other_actors_ = dist_to_other_actors_;
+        p.other_actors_last_visit_ = other_actors_last_visit_;
+        p.coverage_ = coverage_;
+        p.self_coverage_ = self_coverage_;
+        p.dist_to_obstacle_ = dist_to_obstacle_;
+        p.flags_ = flags_;
+        p.num_empty_ = num_empty_;
+        p.num_occupied_ = num_occupied_;
+        p.dist_to_plane_ = dist_to_plane_;
+        p.num_obstacle_pts_ = num_obstacle_pts_;
+        p.num_obstacle_neighbors_ = num_obstacle_neighbors_;
+        p.num_edge_neighbors_ = num_edge_neighbors_;
+        p.path_cost_ = path_cost_;
+        p.reward_ = reward_;
+        p.relative_cost_ = relative_cost_;
+        return p;
+    }
+
+    Vec3 normal() const
+    {
+        return normal_.decode();
+    }
+    void set_normal(const Vec3& n)
+    {
+        normal_.encode(n);
+    }
+
+    // Position stays in floats for the NN index.
+    Value position_[3] = {std::numeric_limits<Value>::quiet_NaN(),
+                          std::numeric_limits<Value>::quiet_NaN(),
+                          std::numeric_limits<Value>::quiet_NaN()};
+    OctNormal normal_{};
+    // Visit times with 1 s resolution (about 18 h from initialization).
+    Quantized<uint16_t, 65535> actor_last_visit_{};
+    Quantized<uint16_t, 65535> other_actors_last_visit_{};
+    // Coverage probabilities need fine resolution to accumulate.
+    Quantized<uint16_t, 1> coverage_{0};
+    Quantized<uint16_t, 1> self_coverage_{0};
+    // Goal selection uses full-precision path costs from the search.
+    BFloat16 path_cost_{};
+    BFloat16 reward_{};
+    // Roughness with 1 mm resolution.
+    Quantized<uint8_t, 255, 1000> ground_diff_std_{};
+    // Distance to obstacle up to 2.54 m with 1 cm resolution.
+    Quantized<uint8_t, 255, 100> dist_to_obstacle_{};
+    // Distances to actors up to 12.7 m with 5 cm resolution.
+    Quantized<uint8_t, 255, 20> dist_to_actor_{};
+    Quantized<uint8_t, 255, 20> dist_to_other_actors_{};
+    uint8_t flags_{0};
+    uint8_t num_empty_ : 4;
+    uint8_t num_occupied_ : 4;
+    // Neighbor counts up to K_NEIGHBORS.
+    uint16_t num_obstacle_neighbors_ : 6;
+    uint16_t num_edge_neighbors_ : 6;
+};
+
+static_assert(Neighborhood::K_NEIGHBORS < (1 << 6), "Neighbor counts of CompactPoint overflow.");
+
+inline void write_point(const std::vector<CompactPoint>& cloud, Index i, uint8_t* out)
+{
+    const Point p = cloud[i];
+    const auto from = reinterpret_cast<const uint8_t*>(&p);
+    std::copy(from, from + sizeof(Point), out);
+}
+
+inline void write_points(const std::vector<CompactPoint>& cloud, uint8_t* out)
+{
+    for (Index i = 0; i < cloud.size(); ++i, out += sizeof(Point))
+    {
+        write_point(cloud, i, out);
+    }
+}
+
+}  // namespace naex
+
+#endif  // NAEX_COMPACT_POINT_H
@@ -0,0 +1,280 @@
+#ifndef NAEX_DELTA_STEPPING_H
+#define NAEX_DELTA_STEPPING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <naex/map.h>
+#include <naex/search_workspace.h>
+#include <naex/types.h>
+#include <vector>
+
+namespace naex
+{
+
+/**
+ * Parallel single-source shortest paths in the map graph by delta-stepping.
+ *
+ * Tentative path costs are grouped into buckets of width delta. Vertices of
+ * the lowest non-empty bucket are expanded in parallel, relaxing light edges
+ * (cost up to delta) until the bucket stays empty, followed by heavy edges of
+ * all vertices removed from the bucket. Delta around the typical edge cost
+ * gives few phases per bucket and enough vertices per phase.
+ *
+ * Path cost and predecessor of each vertex are packed in a single atomic word,
+ * cost bits high, so that concurrent relaxations keep them consistent.
+ * Resulting path costs equal those of sequential Dijkstra search.
+ *
+ * Only labels of reached vertices are written to the workspace and restored
+ * after the search, so that the search does not touch unreached vertices.
+ */
+class DeltaStepping
+{
+public:
+    explicit DeltaStepping(SearchWorkspace& workspace):
+        workspace_(workspace)
+    {}
+
+    /** Path costs and predecessors from source, valid until another search uses the workspace. */
+    const SearchWorkspace& workspace() const
+    {
+        return workspace_;
+    }
+
+    /**
+     * Compute paths from source, leaving vertices beyond max cost unreached.
+     * @return Number of vertices reached.
+     */
+    size_t compute(const Map& map, Vertex source, Value delta,
+                   Value max_cost = std::numeric_limits<Value>::infinity())
+    {
+        assert(delta > 0);
+        const size_t n = size_t(map.num_vertices());
+        reserve(n);
+        delta_ = delta;
+        max_cost_ = max_cost;
+        for (auto& bucket: buckets_)
+        {
+            bucket.clear();
+        }
+        reached_.clear();
+        labels_[source].store(pack(0, source), std::memory_order_relaxed);
+        insert(source);
+
+        std::vector<Vertex> frontier;
+        std::vector<Vertex> removed;
+        for (size_t i = 0; i < buckets_.size(); ++i)
+        {
+            removed.clear();
+            while (!buckets_[i].empty())
+            {
+                // Deduplicate and drop vertices which moved to lower buckets.
+                next_stamp();
+                frontier.clear();
+                for (const auto v: buckets_[i])
+                {
+                    if (stamps_[v] != stamp_ && bucket(cost(v)) == i)
+                    {
+                        stamps_[v] = stamp_;
+                        frontier.push_back(v);
+                    }
+                }
+                buckets_[i].clear();
+                relax_edges(map, frontier, true);
+                removed.insert(removed.end(), frontier.begin(), frontier.end());
+            }
+            relax_edges(map, removed, false);
+            reached_.insert(reached_.end(), removed.begin(), removed.end());
+        }
+
+        // Every vertex with a lowered label was expanded at least once.
+        next_stamp();
+        size_t n_reached = 0;
+        for (const auto v: reached_)
+        {
+            if (stamps_[v] != stamp_)
+            {
+                stamps_[v] = stamp_;
+                reached_[n_reached++] = v;
+            }
+        }
+        reached_.resize(n_reached);
+        workspace_.reset(n);
+        const Word unreached = pack(std::numeric_limits<Value>::infinity(), INVALID_VERTEX);
+        #pragma omp parallel for schedule(static)
+        for (size_t k = 0; k < reached_.size(); ++k)
+        {
+            const Vertex v = reached_[k];
+            const Word label = labels_[v].load(std::memory_order_relaxed);
+            workspace_.set(v, label_cost(label), label_predecessor(label));
+            labels_[v].store(unreached, std::memory_order_relaxed);
+        }
+        // All reached vertices are settled, not in order of path cost.
+        for (const auto v: reached_)
+        {
+            workspace_.settle(v);
+        }
+        return n_reached;
+    }
+
+private:
+    typedef uint64_t Word;
+
+    static uint32_t cost_bits(Value cost)
+    {
+        // Adding zero turns negative zero positive.
+        cost += Value(0);
+        uint32_t bits;
+        std::memcpy(&bits, &cost, sizeof(bits));
+        return bits;
+    }
+
+    /** Non-negative costs order as their bits, which order the packed words. */
+    static Word pack(Value cost, Vertex predecessor)
+    {
+        return (Word(cost_bits(cost)) << 32) | Word(uint32_t(predecessor));
+    }
+
+    static Value label_cost(Word label)
+    {
+        const auto bits = uint32_t(label >> 32);
+        Value cost;
+        std::memcpy(&cost, &bits, sizeof(cost));
+        return cost;
+    }
+
+    static Vertex label_predecessor(Word label)
+    {
+        return Vertex(uint32_t(label));
+    }
+
+    void reserve(size_t n)
+    {
+        if (n <= capacity_)
+        {
+            return;
+        }
+        capacity_ = std::max(n, 2 * capacity_);
+        labels_.reset(new std::atomic<Word>[capacity_]);
+        stamps_.reset(new uint32_t[capacity_]);
+        // Labels are kept unreached between searches.
+        const Word unreached = pack(std::numeric_limits<Value>::infinity(), INVALID_VERTEX);
+        #pragma omp parallel for schedule(static)
+        for (size_t v = 0; v < capacity_; ++v)
+        {
+            labels_[v].store(unreached, std::memory_order_relaxed);
+            stamps_[v] = 0;
+        }
+        stamp_ = 0;
+    }
+
+    void next_stamp()
+    {
+        if (++stamp_ == 0)
+        {
+            std::fill(stamps_.get(), stamps_.get() + capacity_, 0);
+            stamp_ = 1;
+        }
+    }
+
+    Value cost(Vertex v) const
+    {
+        return label_cost(labels_[v].load(std::memory_order_relaxed));
+    }
+
+    size_t bucket(Value cost) const
+    {
+        return size_t(cost / delta_);
+    }
+
+    void insert(Vertex v)
+    {
+        const size_t i = bucket(cost(v));
+        if (i >= buckets_.size())
+        {
+            buckets_.resize(i + 1);
+        }
+        buckets_[i].push_back(v);
+    }
+
+    /** Lower path cost of v, return whether it improved. */
+    bool relax(Vertex u, Vertex v, Value cost)
+    {
+        const Word label = pack(cost, u);
+        const uint32_t bits = uint32_t(label >> 32);
+        Word old = labels_[v].load(std::memory_order_relaxed);
+        while (bits < uint32_t(old >> 32))
+        {
+            if (labels_[v].compare_exchange_weak(old, label, std::memory_order_relaxed))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** Relax light or heavy edges of given vertices and queue improved targets. */
+    void relax_edges(const Map& map, const std::vector<Vertex>& vertices, bool light)
+    {
+        const Vertex* targets = map.graph_.targets_.data();
+        const Value* costs = map.graph_.costs_.data();
+        std::vector<Vertex> improved;
+        #pragma omp parallel
+        {
+            std::vector<Vertex> improved_local;
+            #pragma omp for schedule(dynamic, 64) nowait
+            for (size_t k = 0; k < vertices.size(); ++k)
+            {
+                const Vertex u = vertices[k];
+                const Value cost_u = cost(u);
+                const Edge end = map.graph_.out_end(u);
+                for (Edge e = map.graph_.out_begin(u); e < end; ++e)
+                {
+                    // Costs not computed yet (NaN) and invalid ones are left
+                    // to edge_cost, infinite costs are heavy but never relaxed.
+                    const Value cost_e = costs[e] > 0 ? costs[e] : map.edge_cost(e);
+                    if (light ? !(cost_e <= delta_) : !(cost_e > delta_))
+                    {
+                        continue;
+                    }
+                    const Value cost_v = cost_u + cost_e;
+                    if (cost_v > max_cost_)
+                    {
+                        continue;
+                    }
+                    if (relax(u, targets[e], cost_v))
+                    {
+                        improved_local.push_back(targets[e]);
+                    }
+                }
+            }
+            #pragma omp critical
+            improved.insert(improved.end(), improved_local.begin(), improved_local.end());
+        }
+        for (const auto v: improved)
+        {
+            insert(v);
+        }
+    }
+
+    SearchWorkspace& workspace_;
+    Value delta_{1};
+    Value max_cost_{std::numeric_limits<Value>::infinity()};
+    size_t capacity_{0};
+    std::unique_ptr<std::atomic<Word>[]> labels_{};
+    // Last phase in which the vertex was expanded.
+    std::unique_ptr<uint32_t[]> stamps_{};
+    uint32_t stamp_{0};
+    std::vector<std::vector<Vertex>> buckets_{};
+    // Vertices expanded in the search, with duplicates until its end.
+    std::vector<Vertex> reached_{};
+};
+
+}  // namespace naex
+
+#endif  // NAEX_DELTA_STEPPING_H
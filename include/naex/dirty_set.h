@@ -0,0 +1,209 @@
+#ifndef NAEX_DIRTY_SET_H
+#define NAEX_DIRTY_SET_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <naex/types.h>
+#include <vector>
+
+namespace naex
+{
+
+/**
+ * Set of point indices marked for update.
+ *
+ * Membership is kept in an atomic bitset over point indices and newly
+ * marked indices are appended to a preallocated list, so that insertions
+ * and removals are lock-free and may run concurrently. The list is only
+ * compacted when consumed by indices(), which returns sorted unique indices.
+ *
+ * Resizing, clearing, and consuming must not run concurrently with marking.
+ */
+class DirtySet
+{
+public:
+    typedef uint64_t Word;
+    static const size_t WORD_BITS = 64;
+
+    DirtySet()
+    {}
+
+    DirtySet(const DirtySet&) = delete;
+    DirtySet& operator=(const DirtySet&) = delete;
+
+    /** Number of indices which can be marked. */
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    /** Make room for indices below n, growing geometrically. */
+    void reserve(size_t n)
+    {
+        if (n <= capacity_)
+        {
+            return;
+        }
+        n = std::max(n, 2 * capacity_);
+        const size_t n_words = (n + WORD_BITS - 1) / WORD_BITS;
+        n = n_words * WORD_BITS;
+        std::unique_ptr<std::atomic<Word>[]> words(new std::atomic<Word>[n_words]);
+        const size_t old_words = capacity_ / WORD_BITS;
+        for (size_t i = 0; i < n_words; ++i)
+        {
+            words[i].store(i < old_words ? words_[i].load(std::memory_order_relaxed) : Word(0),
+                           std::memory_order_relaxed);
+        }
+        std::unique_ptr<Index[]> list(new Index[n]);
+        if (overflow())
+        {
+            // Entries are missing, start over from the bitset.
+            const auto marked = indices();
+            std::copy(marked.begin(), marked.end(), list.get());
+            list_size_.store(marked.size(), std::memory_order_relaxed);
+        }
+        else
+        {
+            std::copy(list_.get(), list_.get() + listed(), list.get());
+        }
+        words_.swap(words);
+        list_.swap(list);
+        capacity_ = n;
+    }
+
+    /** Number of marked indices. */
+    size_t size() const
+    {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    bool contains(Index i) const
+    {
+        assert(size_t(i) < capacity_);
+        return words_[word(i)].load(std::memory_order_relaxed) & mask(i);
+    }
+
+    /** Mark index i, return whether it was not marked before. */
+    bool insert(Index i)
+    {
+        assert(size_t(i) < capacity_);
+        const Word old = words_[word(i)].fetch_or(mask(i), std::memory_order_relaxed);
+        if (old & mask(i))
+        {
+            return false;
+        }
+        size_.fetch_add(1, std::memory_order_relaxed);
+        const size_t pos = list_size_.fetch_add(1, std::memory_order_relaxed);
+        // Removed and marked again, list is rebuilt from bitset on overflow.
+        if (pos < capacity_)
+        {
+            list_[pos] = i;
+        }
+        return true;
+    }
+
+    /** Unmark index i, return whether it was marked. */
+    bool erase(Index i)
+    {
+        assert(size_t(i) < capacity_);
+        const Word old = words_[word(i)].fetch_and(~mask(i), std::memory_order_relaxed);
+        if (!(old & mask(i)))
+        {
+            return false;
+        }
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void clear()
+    {
+        if (!overflow())
+        {
+            // Only words of listed indices may be nonzero.
+            for (size_t k = 0; k < listed(); ++k)
+            {
+                words_[word(list_[k])].store(0, std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            for (size_t k = 0; k < capacity_ / WORD_BITS; ++k)
+            {
+                words_[k].store(0, std::memory_order_relaxed);
+            }
+        }
+        size_.store(0, std::memory_order_relaxed);
+        list_size_.store(0, std::memory_order_relaxed);
+    }
+
+    /** Sorted marked indices. */
+    std::vector<Index> indices() const
+    {
+        std::vector<Index> indices;
+        indices.reserve(size());
+        if (!overflow())
+        {
+            for (size_t k = 0; k < listed(); ++k)
+            {
+                if (contains(list_[k]))
+                {
+                    indices.push_back(list_[k]);
+                }
+            }
+            std::sort(indices.begin(), indices.end());
+            indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+            return indices;
+        }
+        for (size_t k = 0; k < capacity_ / WORD_BITS; ++k)
+        {
+            Word w = words_[k].load(std::memory_order_relaxed);
+            while (w)
+            {
+                indices.push_back(Index(k * WORD_BITS + __builtin_ctzll(w)));
+                w &= w - 1;
+            }
+        }
+        return indices;
+    }
+
+private:
+    static size_t word(Index i)
+    {
+        return size_t(i) / WORD_BITS;
+    }
+
+    static Word mask(Index i)
+    {
+        return Word(1) << (size_t(i) % WORD_BITS);
+    }
+
+    /** Whether the list misses some marked indices. */
+    bool overflow() const
+    {
+        return list_size_.load(std::memory_order_relaxed) > capacity_;
+    }
+
+    size_t listed() const
+    {
+        return std::min(list_size_.load(std::memory_order_relaxed), capacity_);
+    }
+
+    std::unique_ptr<std::atomic<Word>[]> words_{};
+    // Indices in order of marking, possibly with duplicates or unmarked.
+    std::unique_ptr<Index[]> list_{};
+    size_t capacity_{0};
+    std::atomic<size_t> size_{0};
+    std::atomic<size_t> list_size_{0};
+};
+
+}  // namespace naex
+
+#endif  // NAEX_DIRTY_SET_H
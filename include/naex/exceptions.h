@@ -6,6 +6,8 @@
 
 #include <boost/stacktrace.hpp>
 #include <exception>
+#include <sstream>
+#include <stdexcept>
 
 namespace naex
 {
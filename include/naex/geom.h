@@ -85,6 +85,44 @@ Value inline inclination(const Vec3& x)
 //    return Value(M_PI_2) - angle_from_up_normalized(x);
 }
 
+/**
+ * Arc tangent of y / x for x >= 0, within 1e-5 rad.
+ * Branch-free, so that loops using it vectorize.
+ */
+template<typename T>
+T inline fast_atan2(T y, T x)
+{
+    const T ay = std::abs(y);
+    const T hi = std::max(ay, x);
+    const T lo = std::min(ay, x);
+    // Zero over the smallest normal number stays zero without branching.
+    const T a = lo / std::max(hi, std::numeric_limits<T>::min());
+    const T s = a * a;
+    // Minimax polynomial of atan on [0, 1].
+    T r = a * (T(0.99997726) + s * (T(-0.33262347) + s * (T(0.19354346)
+            + s * (T(-0.11643287) + s * (T(0.05265332) + s * T(-0.01172120))))));
+    r = ay > x ? T(M_PI_2) - r : r;
+    return y < 0 ? -r : r;
+}
+
+/**
+ * Inclination w.r.t. x-y plane, approximated by fast_atan2.
+ */
+template<typename T>
+T inline fast_inclination(T x, T y, T z)
+{
+    return fast_atan2(z, std::sqrt(x * x + y * y));
+}
+
+/**
+ * Angle wrapped to [-pi, pi].
+ */
+template<typename T>
+T inline wrap_angle(T a)
+{
+    return std::remainder(a, T(2 * M_PI));
+}
+
 /**
  * Plane from three points (in non-degenerate configuration).
  * @tparam Derived
@@ -5,6 +5,7 @@
 #ifndef NAEX_GRAPH_H
 #define NAEX_GRAPH_H
 
+#include <boost/graph/graph_concepts.hpp>
 #include <naex/map.h>
 
 using namespace naex;
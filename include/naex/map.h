@@ -3,18 +3,29 @@
 
 #include <cstddef>
 #include <cmath>
+#include <memory>
 #include <mutex>
 #include <naex/buffer.h>
 #include <naex/clouds.h>
+#include <naex/coarse_graph.h>
+#include <naex/compact_point.h>
+#include <naex/dirty_set.h>
+#include <naex/exceptions.h>
 #include <naex/geom.h>
 #include <naex/iterators.h>
+#include <naex/neighbor_graph.h>
 #include <naex/nearest_neighbors.h>
+#include <naex/point_arrays.h>
+#include <naex/range_image.h>
+#include <naex/symmetric_eigen.h>
 #include <naex/timer.h>
 #include <naex/types.h>
+#include <naex/voxel_index.h>
 #include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <string>
+#include <unordered_map>
 //#include <set>
-#include <unordered_set>
 
 namespace naex
 {
@@ -24,6 +35,30 @@ public:
     typedef std::recursive_mutex Mutex;
     typedef std::lock_guard<Mutex> Lock;
 
+    // Point storage layout, array of structures by default,
+    // structure of arrays with NAEX_SOA, quantized points with NAEX_COMPACT.
+#if defined(NAEX_SOA) && defined(NAEX_COMPACT)
+#error "NAEX_SOA and NAEX_COMPACT are mutually exclusive."
+#endif
+#ifdef NAEX_SOA
+    typedef PointArrays Cloud;
+#elif defined(NAEX_COMPACT)
+    typedef std::vector<CompactPoint> Cloud;
+#else
+    typedef std::vector<Point> Cloud;
+#endif
+
+    // Incremental spatial index over point positions.
+    typedef VoxelIndex<Value> SpatialIndex;
+
+    /** Neighbors of points to merge, found in an index snapshot. */
+    struct MergeNeighbors
+    {
+        std::shared_ptr<SpatialIndex> index;
+        size_t num_added{0};
+        std::unique_ptr<Query<Elem>> query;
+    };
+
     static const size_t DEFAULT_CAPACITY = 10000000;
 
     Map()
@@ -41,28 +76,12 @@ public:
             return FlannMat();
         }
         Index size = (start < end) ? end - start : Index(cloud_.size()) - start;
-        auto res = FlannMat(cloud_[start].position_, static_cast<size_t>(size), 3, sizeof(Point));
+        auto res = naex::position_matrix(cloud_, start, size);
 //        ROS_INFO("Position matrix %lu-by-%lu. First point: [%.2f, %.2f, %.2f].",
 //                 res.rows, res.cols, res[0][0], res[0][1], res[0][2]);
         return res;
     }
 
-    flann::Matrix<int> neighbor_matrix()
-    {
-        if (cloud_.empty()) {
-            return flann::Matrix<int>();
-        }
-        // TODO: Inconsistency between boost graph (Index = uint32) and flann (int).
-//        return flann::Matrix<int>(reinterpret_cast<int*>(cloud_[0].neighbors_),
-//                                  graph_.size(),
-//                                  3,
-//                                  sizeof(Point));
-        return flann::Matrix<int>(reinterpret_cast<int*>(graph_[0].neighbors_),
-                                  graph_.size(),
-                                  Neighborhood::K_NEIGHBORS,
-                                  sizeof(Neighborhood));
-    }
-
     Value* position(size_t i)
     {
         return &cloud_[i].position_[0];
@@ -73,14 +92,9 @@ public:
         return &cloud_[i].position_[0];
     }
 
-    Value* normal(size_t i)
-    {
-        return &cloud_[i].normal_[0];
-    }
-
-    const Value* normal(size_t i) const
+    Vec3 normal(size_t i) const
     {
-        return &cloud_[i].normal_[0];
+        return cloud_[i].normal();
     }
 
 //    template<T>
@@ -95,7 +109,8 @@ public:
 //                && Value(cloud_[i].num_empty_) / cloud_[i].num_occupied_ >= min_empty_ratio_;
 //    }
 
-    bool point_empty(const Point& p)
+    template<typename P>
+    bool point_empty(const P& p)
     {
         return p.num_empty_ >= min_num_empty_
             && Value(p.num_empty_) / p.num_occupied_ >= min_empty_ratio_;
@@ -118,10 +133,15 @@ public:
         return cost > 0;
     }
 
-    inline Cost compute_edge_cost(const Edge& e)
+    /** Radius of neighborhoods kept in the graph. */
+    inline Value graph_radius() const
+    {
+        return std::max(neighborhood_radius_, clearance_radius_);
+    }
+
+    inline Cost compute_edge_cost(const Edge& e) const
     {
         const auto v0 = source(e);
-        const auto v1_index = target_index(e);
         const auto v1 = target(e);
 
         if (v0 == v1)
@@ -134,17 +154,18 @@ public:
             return std::numeric_limits<Cost>::infinity();
         }
 //        Cost d = std::sqrt(cloud_[v0].distances_[v1_index]);
-        Cost c = graph_[v0].distances_[v1_index];
+        Cost c = graph_.distances_[e];
         if (c > 3 * points_min_dist_)
         {
             return std::numeric_limits<Cost>::infinity();
         }
 
         // Check pitch and roll limits.
+        // Approximate inclination is used, as in compute_out_edge_costs.
         const Vec3 forward = ConstVec3Map(cloud_[v1].position_) - ConstVec3Map(cloud_[v0].position_);
-        const Vec3 left = ConstVec3Map(cloud_[v1].normal_).cross(forward);
-        Value pitch = inclination(forward);
-        Value roll = inclination(left);
+        const Vec3 left = cloud_[v1].normal().cross(forward);
+        Value pitch = fast_inclination(forward(0), forward(1), forward(2));
+        Value roll = fast_inclination(left(0), left(1), left(2));
         if (std::abs(pitch) > max_pitch_ || std::abs(roll) > max_roll_)
         {
             return std::numeric_limits<Cost>::infinity();
@@ -172,30 +193,99 @@ public:
         return c;
     }
 
+    /**
+     * Compute costs of all out edges of vertex v0 as compute_edge_cost does.
+     * Neighbor data are gathered into contiguous arrays first, so that
+     * the cost formulas vectorize over the neighbors.
+     */
+    void compute_out_edge_costs(Vertex v0)
+    {
+        const Index K = Neighborhood::K_NEIGHBORS;
+        alignas(32) Value fx[K], fy[K], fz[K], nx[K], ny[K], nz[K];
+        alignas(32) Value dist[K], obstacle_factor[K], edge_factor[K], obstacles_factor[K];
+        alignas(32) uint8_t valid[K];
+        alignas(32) Value costs[K];
+
+        const Edge begin = graph_.out_begin(v0);
+        const Index n = Index(graph_.out_end(v0) - begin);
+        assert(n <= K);
+        const Vec3 p0 = ConstVec3Map(cloud_[v0].position_);
+        for (Index k = 0; k < n; ++k)
+        {
+            const Vertex v1 = graph_.targets_[begin + k];
+            const auto& p1 = cloud_[v1];
+            const Vec3 normal = p1.normal();
+            fx[k] = p1.position_[0] - p0(0);
+            fy[k] = p1.position_[1] - p0(1);
+            fz[k] = p1.position_[2] - p0(2);
+            nx[k] = normal(0);
+            ny[k] = normal(1);
+            nz[k] = normal(2);
+            dist[k] = graph_.distances_[begin + k];
+            valid[k] = v1 != v0 && (p1.flags_ & TRAVERSABLE) && !(p1.flags_ & EDGE);
+            obstacle_factor[k] = std::isfinite(p1.dist_to_obstacle_)
+                                 ? 1 + std::max(Value(0), 1 - p1.dist_to_obstacle_ / (2 * clearance_radius_))
+                                 : Value(1);
+            edge_factor[k] = 1 + Value(p1.num_edge_neighbors_) / Neighborhood::K_NEIGHBORS;
+            obstacles_factor[k] = 1 + Value(p1.num_obstacle_neighbors_) / Neighborhood::K_NEIGHBORS;
+        }
+
+        const Value max_dist = 3 * points_min_dist_;
+        #pragma omp simd
+        for (Index k = 0; k < n; ++k)
+        {
+            // Left = normal x forward.
+            const Value lx = ny[k] * fz[k] - nz[k] * fy[k];
+            const Value ly = nz[k] * fx[k] - nx[k] * fz[k];
+            const Value lz = nx[k] * fy[k] - ny[k] * fx[k];
+            const Value pitch = std::abs(fast_inclination(fx[k], fy[k], fz[k]));
+            const Value roll = std::abs(fast_inclination(lx, ly, lz));
+            Value c = dist[k];
+            c += c * inclination_penalty_ * (pitch / max_pitch_ + roll / max_roll_);
+            c *= obstacle_factor[k];
+            c *= edge_factor[k];
+            c *= obstacles_factor[k];
+            // Bitwise and avoids branches of short-circuit evaluation.
+            const bool ok = bool(valid[k]) & !(dist[k] > max_dist) & !(pitch > max_pitch_) & !(roll > max_roll_);
+            costs[k] = ok ? c : std::numeric_limits<Value>::infinity();
+        }
+        std::copy(costs, costs + n, graph_.costs_.data() + begin);
+    }
+
+    /**
+     * Edge cost, infinite for invalid edges. Costs not computed yet (NaN)
+     * are computed on first access and memoized. Concurrent searches may
+     * compute the same deterministic cost, so relaxed atomics suffice.
+     */
     inline Cost edge_cost(const Edge& e) const
     {
-        const auto v0 = source(e);
-        const auto v1_index = target_index(e);
-        const auto& stored = graph_[v0].costs_[v1_index];
-        return valid_cost(stored) ? stored : std::numeric_limits<Value>::infinity();
+        // Memoized costs are a cache, not a logical change of the map.
+        Value* stored = const_cast<Value*>(graph_.costs_.data()) + e;
+        Value c;
+        __atomic_load(stored, &c, __ATOMIC_RELAXED);
+        if (std::isnan(c))
+        {
+            c = compute_edge_cost(e);
+            if (std::isnan(c))
+            {
+                c = std::numeric_limits<Value>::infinity();
+            }
+            __atomic_store(stored, &c, __ATOMIC_RELAXED);
+        }
+        return valid_cost(c) ? c : std::numeric_limits<Value>::infinity();
     }
 
+    /** Build the index from scratch, new points are added incrementally in merge. */
     void update_index()
     {
         Timer t;
-        // TODO: Update only dirty points.
         if (!empty())
         {
             Lock cloud_lock(cloud_mutex_);
-            Lock index_lock(index_mutex_);
-//                index_ = std::make_shared<flann::Index<flann::L2_3D<Elem>>>(points_, flann::KDTreeSingleIndexParams());
-            index_ = std::make_shared<flann::Index<flann::L2_3D<Value>>>(
-                    position_matrix(),
-                    flann::KDTreeSingleIndexParams());
-            // TODO: Is this necessary?
-            index_->buildIndex();
+            auto index = std::make_shared<SpatialIndex>(position_matrix(), index_voxel_size_);
+            std::atomic_store(&index_, index);
             ROS_DEBUG("Index updated for %lu points (%.3f s).",
-                      index_->size(), t.seconds_elapsed());
+                      index->size(), t.seconds_elapsed());
         }
         else
         {
@@ -223,32 +313,27 @@ public:
         // NB: It should be stable iteration order.
         Timer t;
 
-        std::vector<Neighborhood> dirty_cloud;
-
+        // Gather dirty positions only, independently of storage layout.
+        std::vector<Value> dirty_positions;
         for (It it = begin; it != end; ++it)
         {
-            dirty_cloud.push_back(graph_[*it]);
+            const auto& position = cloud_[*it].position_;
+            dirty_positions.insert(dirty_positions.end(), position, position + 3);
         }
+        const size_t n_dirty = dirty_positions.size() / 3;
 
-        if (dirty_cloud.empty())
+        if (n_dirty == 0)
         {
             ROS_DEBUG("Graph up to date, no points to update (%.3f s).",
                      t.seconds_elapsed());
             return;
         }
 
-        flann::Matrix<Value> positions(dirty_cloud[0].position_,
-                                       dirty_cloud.size(),
-                                       3,
-                                       sizeof(Neighborhood));
-        flann::Matrix<Index> neighbors(dirty_cloud[0].neighbors_,
-                                       dirty_cloud.size(),
-                                       Neighborhood::K_NEIGHBORS,
-                                       sizeof(Neighborhood));
-        flann::Matrix<Value> distances(dirty_cloud[0].distances_,
-                                       dirty_cloud.size(),
-                                       Neighborhood::K_NEIGHBORS,
-                                       sizeof(Neighborhood));
+        std::vector<Index> dirty_neighbors(n_dirty * Neighborhood::K_NEIGHBORS);
+        std::vector<Value> dirty_distances(n_dirty * Neighborhood::K_NEIGHBORS);
+        flann::Matrix<Value> positions(dirty_positions.data(), n_dirty, 3);
+        flann::Matrix<Index> neighbors(dirty_neighbors.data(), n_dirty, Neighborhood::K_NEIGHBORS);
+        flann::Matrix<Value> distances(dirty_distances.data(), n_dirty, Neighborhood::K_NEIGHBORS);
 
         t.reset();
         flann::SearchParams params;
@@ -256,38 +341,49 @@ public:
         params.cores = 0;
         params.max_neighbors = Neighborhood::K_NEIGHBORS;
         params.sorted = true;
+        const Value radius = graph_radius();
+        index()->radiusSearch(positions, neighbors, distances, radius * radius, params);
+//        ROS_INFO("Search complete (%.3f s).", t.seconds_elapsed());
+        // Propagate valid neighbors within radius into the main graph,
+        // the point itself first. Edge costs are invalidated to enforce
+        // recomputation.
+        Index row_neighbors[Neighborhood::K_NEIGHBORS];
+        Value row_distances[Neighborhood::K_NEIGHBORS];
+        size_t i = 0;
+        for (It it = begin; it != end; ++it, ++i)
         {
-            Lock cloud_lock(cloud_mutex_);
-            Lock index_lock(index_mutex_);
-            index_->knnSearch(positions, neighbors, distances,
-                              Neighborhood::K_NEIGHBORS, params);
-            // FIXME: Radius search with max K seems to result in errors.
-//            index_->radiusSearch(positions, neighbors, distances,
-//                                 neighborhood_radius_, params);
+            const Vertex v0 = *it;
+            Index n = 0;
+            row_neighbors[n] = v0;
+            row_distances[n] = 0;
+            ++n;
+            for (Index j = 0; j < Neighborhood::K_NEIGHBORS; ++j)
+            {
+                if (!valid_neighbor(neighbors[i][j], distances[i][j]) || neighbors[i][j] == v0)
+                {
+                    continue;
+                }
+                const Value d = std::sqrt(distances[i][j]);
+                if (d > radius || n == Neighborhood::K_NEIGHBORS)
+                {
+                    continue;
+                }
+                row_neighbors[n] = neighbors[i][j];
+                row_distances[n] = d;
+                ++n;
+            }
+            graph_.set_neighbors(v0, row_neighbors, row_distances, n);
         }
-//        ROS_INFO("Search complete (%.3f s).", t.seconds_elapsed());
-        // Propagate NN info into the main graph.
-        auto point_it = dirty_cloud.begin();
-        for (It it = begin; it != end; ++it, ++point_it)
+        if (graph_.fragmented())
         {
-            std::copy((*point_it).neighbors_,
-                      (*point_it).neighbors_ + Neighborhood::K_NEIGHBORS,
-                      graph_[*it].neighbors_);
-//            std::copy((*point_it).distances_,
-//                      (*point_it).distances_ + Neighborhood::K_NEIGHBORS,
-//                      graph_[*it].distances_);
-            std::transform((*point_it).distances_,
-                           (*point_it).distances_ + Neighborhood::K_NEIGHBORS,
-                           graph_[*it].distances_,
-                           [](const Value x) -> Value { return std::sqrt(x); });
-            // Invalidate computed edge costs to enforce recomputation.
-            std::fill(graph_[*it].costs_,
-                      graph_[*it].costs_ + Neighborhood::K_NEIGHBORS,
-                      std::numeric_limits<Value>::quiet_NaN());
+            Timer t_compact;
+            graph_.compact();
+            ROS_DEBUG("Graph compacted to %lu edge slots (%.3f s).",
+                      size_t(graph_.num_slots()), t_compact.seconds_elapsed());
         }
 
-        ROS_DEBUG("Neighborhood updated at %lu / %lu pts (%.3f s).",
-                  dirty_cloud.size(), cloud_.size(), t.seconds_elapsed());
+        ROS_DEBUG("Neighborhood updated at %lu / %lu pts, %lu edges (%.3f s).",
+                  n_dirty, cloud_.size(), size_t(graph_.num_edges()), t.seconds_elapsed());
         // TODO: Update features and labels.
     }
 
@@ -295,23 +391,27 @@ public:
     void compute_edge_costs(It begin, It end)
     {
         Timer t;
-        size_t n = 0;
-        for (It it = begin; it != end; ++it)
+        const auto n = size_t(end - begin);
+        // Rows of out edges are disjoint and cost updates are marked lock-free.
+        #pragma omp parallel for schedule(dynamic, 256)
+        for (size_t i = 0; i < n; ++i)
         {
-            ++n;
-            const auto v0 = *it;
-            Index e0 = v0 * Neighborhood::K_NEIGHBORS;
-//            Index e1 = (v0 + 1) * Neighborhood::K_NEIGHBORS;
-//            for (Index e = e0, i = 0; e < e1; ++e, ++v1)
-//            {
-//                graph_[v0].costs_[v1] =  edge_cost(e);
-//            }
-            for (Index i = 0, e = e0; i < Neighborhood::K_NEIGHBORS; ++i, ++e)
+            const auto v0 = begin[i];
+            if (lazy_edge_costs_)
             {
-                graph_[v0].costs_[i] = compute_edge_cost(e);
+                // Lazy costs are computed on first access in edge_cost.
+                const auto edges = out_edges(v0);
+                std::fill(graph_.costs_.data() + *edges.first, graph_.costs_.data() + *edges.second,
+                          std::numeric_limits<Value>::quiet_NaN());
             }
+            else
+            {
+                compute_out_edge_costs(v0);
+            }
+            cost_updates_.insert(v0);
         }
-        ROS_INFO("Edge costs computed for %lu vertices (%.3f s).", n, t.seconds_elapsed());
+        ROS_INFO("Edge costs %s for %lu vertices (%.3f s).",
+                 lazy_edge_costs_ ? "invalidated" : "computed", n, t.seconds_elapsed());
     }
 
     inline Vertex num_vertices() const
@@ -320,8 +420,7 @@ public:
     }
     inline Edge num_edges() const
     {
-        // TODO: Compute true number based on valid neighbors.
-        return num_vertices() * Neighborhood::K_NEIGHBORS;
+        return graph_.num_edges();
     }
     inline std::pair<VertexIter, VertexIter> vertices() const
     {
@@ -329,29 +428,19 @@ public:
     }
     inline std::pair<EdgeIter, EdgeIter> out_edges(const Vertex& u) const
     {
-        // TODO: Limit to valid edges here or just by costs?
-        // Skip the first neighbor - the vertex itself.
-        return { u * Neighborhood::K_NEIGHBORS + 1, (u + 1) * Neighborhood::K_NEIGHBORS };
+        return { graph_.out_begin(u), graph_.out_end(u) };
     }
     inline Edge out_degree(const Vertex& u) const
     {
-        // TODO: Compute true number based on valid neighbors.
-//        return num_edges();
-        return Neighborhood::K_NEIGHBORS - 1;
+        return graph_.out_degree(u);
     }
     inline Vertex source(const Edge& e) const
     {
-//        return e / num_edges();
-        return e / Neighborhood::K_NEIGHBORS;
-    }
-    inline Vertex target_index(const Edge& e) const
-    {
-//        return e % num_edges();
-        return e % Neighborhood::K_NEIGHBORS;
+        return graph_.source(e);
     }
     inline Vertex target(const Edge& e) const
     {
-        return graph_[source(e)].neighbors_[target_index(e)];
+        return graph_.target(e);
     }
 
     void update_dirty()
@@ -359,12 +448,19 @@ public:
         Lock lock(dirty_mutex_);
         Timer t;
 
-        update_neighborhood(dirty_indices_.begin(), dirty_indices_.end());
-        compute_features(dirty_indices_.begin(), dirty_indices_.end());
-        compute_labels(dirty_indices_.begin(), dirty_indices_.end());
-        compute_edge_costs(dirty_indices_.begin(), dirty_indices_.end());
+        // Process sorted contiguous indices for locality and parallel loops.
+        const std::vector<Index> dirty = dirty_indices_.indices();
 
-        ROS_DEBUG("%lu points updated (%.3f s).", dirty_indices_.size(), t.seconds_elapsed());
+        update_neighborhood(dirty.begin(), dirty.end());
+        compute_features(dirty);
+        compute_labels(dirty);
+        compute_edge_costs(dirty.begin(), dirty.end());
+        if (coarse_voxel_size_ > 0)
+        {
+            coarse_graph_.update(*this, dirty, coarse_voxel_size_);
+        }
+
+        ROS_DEBUG("%lu points updated (%.3f s).", dirty.size(), t.seconds_elapsed());
     }
 
     void clear_updated()
@@ -375,6 +471,22 @@ public:
         ROS_DEBUG("%lu updated indices cleared.", n);
     }
 
+    /** Vertices with edge costs recomputed since the last call. */
+    std::vector<Vertex> take_cost_updates()
+    {
+        Lock lock(dirty_mutex_);
+        auto updates = cost_updates_.indices();
+        cost_updates_.clear();
+        return updates;
+    }
+
+    /** Vertices with edge costs recomputed since the last take_cost_updates. */
+    std::vector<Vertex> pending_cost_updates() const
+    {
+        Lock lock(dirty_mutex_);
+        return cost_updates_.indices();
+    }
+
     void clear_dirty()
     {
         Lock lock(dirty_mutex_);
@@ -388,17 +500,24 @@ public:
 
     }
 
-    template<typename It>
-    void compute_features(It begin, It end)
+    /** Compute normals and edge labels at given points in parallel. */
+    void compute_features(const std::vector<Index>& indices)
     {
         Timer t;
         const auto semicircle_centroid_offset = Value(4.0 * neighborhood_radius_ / (3.0 * M_PI));
-        Index n = 0;
+        const Index n = Index(indices.size());
         Index n_edge = 0;
-
-        for (It it = begin; it != end; ++it, ++n)
+        // Flags are applied after the loop as neighbors read them.
+        std::vector<uint8_t> edge(indices.size(), 0);
+        // Covariances of static points are solved in a batch.
+        SmallestEigenpairs eigen;
+        eigen.resize(indices.size());
+
+        // Only features of v0 are written, neighbors are read-only.
+        #pragma omp parallel for schedule(dynamic, 256) reduction(+:n_edge)
+        for (Index i = 0; i < n; ++i)
         {
-            const auto v0 = *it;
+            const auto v0 = indices[i];
 
             // Disregard empty / dynamic points.
             if (!(cloud_[v0].flags_ & STATIC))
@@ -407,17 +526,13 @@ public:
             }
 
             // Estimate normals (local surface orientation).
+            const Vec3 p0 = ConstVec3Map(cloud_[v0].position_);
             Vec3 mean = Vec3::Zero();
             Mat3 cov = Mat3::Zero();
-            cloud_[v0].normal_support_ = 0;
+            uint8_t normal_support = 0;
             // First neighbor is the point itself.
-            for (Index j = 0; j < Neighborhood::K_NEIGHBORS; ++j)
+            for (Index j = 0; j < graph_[v0].neighbor_count_; ++j)
             {
-                if (!valid_neighbor(graph_[v0].neighbors_[j], graph_[v0].distances_[j]))
-                {
-                    continue;
-                }
-
                 Index v1 = graph_[v0].neighbors_[j];
 
                 // Disregard empty points.
@@ -428,26 +543,38 @@ public:
                 if (graph_[v0].distances_[j] <= clearance_radius_) {
                     mean += ConstVec3Map(cloud_[v1].position_);
 //                    Vec3 pc = (ConstVec3Map(cloud_[v1].position_) - mean);
-                    Vec3 pc = (ConstVec3Map(cloud_[v1].position_) - ConstVec3Map(cloud_[v0].position_));
+                    Vec3 pc = (ConstVec3Map(cloud_[v1].position_) - p0);
                     cov += pc * pc.transpose();
-                    ++cloud_[v0].normal_support_;
+                    ++normal_support;
                 }
             }
-            mean /= cloud_[v0].normal_support_;
-            cov /= cloud_[v0].normal_support_;
-            Eigen::SelfAdjointEigenSolver<Mat3> solver(cov);
-            Vec3Map normal(cloud_[v0].normal_);
-            normal = solver.eigenvectors().col(0);
-
-            // Compute other properties dependent on normal.
-            cloud_[v0].ground_diff_std_ = std::sqrt(solver.eigenvalues()(0));
+            cloud_[v0].normal_support_ = normal_support;
+            mean /= normal_support;
+            cov /= normal_support;
+            eigen.set(i, cov);
 
             // Inject support label here where we have mean at hand.
-            const auto centroid_offset = (mean - ConstVec3Map(cloud_[v0].position_)).norm();
+            const auto centroid_offset = (mean - p0).norm();
             if (centroid_offset > edge_min_centroid_offset_ * semicircle_centroid_offset)
+            {
+                edge[i] = 1;
+                ++n_edge;
+            }
+        }
+        eigen.compute();
+        for (Index i = 0; i < n; ++i)
+        {
+            const auto v0 = indices[i];
+            if (!(cloud_[v0].flags_ & STATIC))
+            {
+                continue;
+            }
+            cloud_[v0].set_normal(eigen.eigenvector(i));
+            // Compute other properties dependent on normal.
+            cloud_[v0].ground_diff_std_ = std::sqrt(eigen.eigenvalue(i));
+            if (edge[i])
             {
                 cloud_[v0].flags_ |= EDGE;
-                n_edge;
             }
             else
             {
@@ -458,23 +585,28 @@ public:
                   size_t(n_edge), size_t(n), t.seconds_elapsed());
     }
 
-    template<typename It>
-    void compute_labels(It begin, It end)
+    /**
+     * Compute labels at given points in parallel.
+     *
+     * Horizontal labels are computed first for all points, so that the
+     * labels depending on neighbors do not depend on processing order.
+     */
+    void compute_labels(const std::vector<Index>& indices)
     {
         Timer t;
-        Index n = 0;
+        const Index n = Index(indices.size());
         Index n_horizontal = 0;
         Index n_traverable = 0;
         Index n_empty = 0;
         Index n_actor = 0;
-        Index n_obstacle = 0;
 
         const auto max_slope = std::max(max_pitch_, max_roll_);
         const auto min_z = std::cos(max_slope);
 
-        for (It it = begin; it != end; ++it, ++n)
+        #pragma omp parallel for schedule(dynamic, 256) reduction(+:n_horizontal, n_empty, n_actor)
+        for (Index i = 0; i < n; ++i)
         {
-            const auto v0 = *it;
+            const auto v0 = indices[i];
 
             // Disregard empty points. Don't recompute anything for these.
             if (!(cloud_[v0].flags_ & STATIC))
@@ -483,9 +615,6 @@ public:
                 continue;
             }
 
-            // Clear flags we may set later.
-            cloud_[v0].flags_ &= ~(HORIZONTAL | TRAVERSABLE);
-
             // Actor flag is temporary and orthogonal to others.
             // TODO: Update distances to actors in planning.
             if (cloud_[v0].flags_ & ACTOR)
@@ -494,38 +623,51 @@ public:
             }
 
             // TODO: Check sign once normals keep consistent orientation.
-            if (std::abs(cloud_[v0].normal_[2]) >= min_z)
+            if (std::abs(cloud_[v0].normal()(2)) >= min_z)
             {
                 // Approx. horizontal based on normal.
                 cloud_[v0].flags_ |= HORIZONTAL;
                 ++n_horizontal;
             }
-//            else  // if (std::abs(normals_[i][2]) < min_z)
-//            {
-//                // Approx. vertical based on normal.
-//                cloud_[v0].flags_ &= ~(HORIZONTAL | TRAVERSABLE);
-//            }
+            else
+            {
+                cloud_[v0].flags_ &= ~HORIZONTAL;
+            }
+        }
+
+        // Only labels of v0 are written, flags are applied after the loop
+        // as neighbors read them.
+        std::vector<uint8_t> traversable(indices.size(), 0);
+        #pragma omp parallel for schedule(dynamic, 256) reduction(+:n_traverable)
+        for (Index i = 0; i < n; ++i)
+        {
+            const auto v0 = indices[i];
+
+            if (!(cloud_[v0].flags_ & STATIC))
+            {
+                continue;
+            }
+
+            // Decode point once, accumulate in locals, and store at the end
+            // (members may be quantized).
+            const Vec3 p0 = ConstVec3Map(cloud_[v0].position_);
+            const Vec3 n0 = cloud_[v0].normal();
 
             // Count edge neighbors (must run in the second pass).
-            cloud_[v0].num_edge_neighbors_ = 0;
-            cloud_[v0].num_obstacle_neighbors_ = 0;
+            uint8_t num_edge_neighbors = 0;
+            uint8_t num_obstacle_neighbors = 0;
             // Compute ground features (need second loop through neighbors).
-            cloud_[v0].min_ground_diff_ = std::numeric_limits<Elem>::infinity();
-            cloud_[v0].max_ground_diff_ = -std::numeric_limits<Elem>::infinity();
-            cloud_[v0].mean_abs_ground_diff_ = 0.;
+            Value min_ground_diff = std::numeric_limits<Elem>::infinity();
+            Value max_ground_diff = -std::numeric_limits<Elem>::infinity();
+            Value mean_abs_ground_diff = 0.;
             // Compute clearance.
-            cloud_[v0].dist_to_obstacle_ = std::numeric_limits<Value>::infinity();
-            cloud_[v0].num_obstacle_pts_ = 0;
+            Value dist_to_obstacle = std::numeric_limits<Value>::infinity();
+            uint8_t num_obstacle_pts = 0;
             Index n_cylinder_pts = 0;
 
-            for (Vertex j = 0; j < Neighborhood::K_NEIGHBORS; ++j)
+            for (Index j = 0; j < graph_[v0].neighbor_count_; ++j)
             {
                 const auto v1 = graph_[v0].neighbors_[j];
-                // Disregard invalid neighbors.
-                if (!valid_neighbor(v1, graph_[v0].distances_[j]))
-                {
-                    continue;
-                }
                 // Disregard distant neighbors.
                 if (graph_[v0].distances_[j] > neighborhood_radius_)
                 {
@@ -540,12 +682,7 @@ public:
 
                 if (cloud_[v1].flags_ & EDGE)
                 {
-                    ++cloud_[v0].num_edge_neighbors_;
-                }
-
-                if (!(cloud_[v1].flags_ & HORIZONTAL))
-                {
-                    ++cloud_[v0].num_obstacle_neighbors_;
+                    ++num_edge_neighbors;
                 }
 
                 // Avoid driving near obstacles.
@@ -553,16 +690,11 @@ public:
                 // Hard constraint can be removed with min_dist_to_obstacle_.
                 if (!(cloud_[v1].flags_ & HORIZONTAL))
                 {
-                    if (graph_[v0].distances_[j] <= min_dist_to_obstacle_)
-                    {
-                        cloud_[v0].flags_ &= ~TRAVERSABLE;
-                    }
-                    cloud_[v0].dist_to_obstacle_ = std::min(graph_[v0].distances_[j], cloud_[v0].dist_to_obstacle_);
+                    ++num_obstacle_neighbors;
+                    dist_to_obstacle = std::min<Value>(graph_[v0].distances_[j], dist_to_obstacle);
                 }
 
-                Vec3Map p0(cloud_[v0].position_);
-                Vec3Map p1(cloud_[v1].position_);
-                Vec3Map n0(cloud_[v0].normal_);
+                ConstVec3Map p1(cloud_[v1].position_);
 
                 Value height_diff = n0.dot(p1 - p0);
                 Vec3 ground_pt = p1 - height_diff * n0;
@@ -570,35 +702,58 @@ public:
 
                 if (ground_dist <= clearance_radius_)
                 {
-                    cloud_[v0].min_ground_diff_ = std::min(height_diff, cloud_[v0].min_ground_diff_);
-                    cloud_[v0].max_ground_diff_ = std::max(height_diff, cloud_[v0].max_ground_diff_);
-                    cloud_[v0].mean_abs_ground_diff_ += std::abs(height_diff);
+                    min_ground_diff = std::min(height_diff, min_ground_diff);
+                    max_ground_diff = std::max(height_diff, max_ground_diff);
+                    mean_abs_ground_diff += std::abs(height_diff);
                     ++n_cylinder_pts;
                     if (height_diff >= clearance_low_ && height_diff <= clearance_high_)
                     {
-                        ++cloud_[v0].num_obstacle_pts_;
+                        ++num_obstacle_pts;
                     }
                 }
             }
-            cloud_[v0].mean_abs_ground_diff_  /= n_cylinder_pts;
+            mean_abs_ground_diff /= n_cylinder_pts;
+            cloud_[v0].num_edge_neighbors_ = num_edge_neighbors;
+            cloud_[v0].num_obstacle_neighbors_ = num_obstacle_neighbors;
+            cloud_[v0].min_ground_diff_ = min_ground_diff;
+            cloud_[v0].max_ground_diff_ = max_ground_diff;
+            cloud_[v0].mean_abs_ground_diff_ = mean_abs_ground_diff;
+            cloud_[v0].dist_to_obstacle_ = dist_to_obstacle;
+            cloud_[v0].num_obstacle_pts_ = num_obstacle_pts;
             if ((cloud_[v0].flags_ & HORIZONTAL)
-                    && cloud_[v0].num_obstacle_pts_ < min_points_obstacle_
-                    && cloud_[v0].min_ground_diff_ >= min_ground_diff_
-                    && cloud_[v0].max_ground_diff_ <= max_ground_diff_
+                    && num_obstacle_pts < min_points_obstacle_
+                    && min_ground_diff >= min_ground_diff_
+                    && max_ground_diff <= max_ground_diff_
                     && cloud_[v0].ground_diff_std_ <= max_ground_diff_std_
-                    && cloud_[v0].mean_abs_ground_diff_ <= max_mean_abs_ground_diff_)
+                    && mean_abs_ground_diff <= max_mean_abs_ground_diff_)
             {
-                cloud_[v0].flags_ |= TRAVERSABLE;
+                traversable[i] = 1;
                 ++n_traverable;
             }
         }
+        for (Index i = 0; i < n; ++i)
+        {
+            const auto v0 = indices[i];
+            if (!(cloud_[v0].flags_ & STATIC))
+            {
+                continue;
+            }
+            if (traversable[i])
+            {
+                cloud_[v0].flags_ |= TRAVERSABLE;
+            }
+            else
+            {
+                cloud_[v0].flags_ &= ~TRAVERSABLE;
+            }
+        }
         ROS_DEBUG("%lu labels updated: %lu horizontal, %lu traversable, "
                   "%lu empty, %lu actor, (%.3f s).",
                   size_t(n), size_t(n_horizontal), size_t(n_traverable),
                   size_t(n_empty), size_t(n_actor), t.seconds_elapsed());
     }
 
-    /** Resize point buffers if necessary, update wrappers and index. */
+    /** Resize point buffers if necessary, the index keeps its own copy of positions. */
     void reserve(size_t n)
     {
         Timer t;
@@ -607,29 +762,189 @@ public:
         }
         cloud_.reserve(n);
         graph_.reserve(n);
-        update_index();
         ROS_INFO("Capacity increased to %lu points: %.3f s.", n, t.seconds_elapsed());
     }
 
 //    std::vector<Index> nearby_indices(const flann::Matrix<Value>& origin, Value radius)
     std::vector<Index> nearby_indices(Value* origin, Value radius)
     {
-        Lock cloud_lock(cloud_mutex_);
-        Lock index_lock(index_mutex_);
-        RadiusQuery<Value> q(*index_, flann::Matrix<Value>(origin, 1, 3), radius);
+        RadiusQuery<Value> q(*index(), flann::Matrix<Value>(origin, 1, 3), radius);
         // TODO: Is this enough to move it?
         return q.nn_[0];
     }
 
-//    template<typename C>  // C = Camera
-    void update_occupancy_organized(const sensor_msgs::PointCloud2& cloud,
-                                    const geometry_msgs::Transform& cloud_to_map_tf)
-//                                    const C* camera)
+    /**
+     * Indices of map points within range and angular bounds of sensor
+     * projection, sensor frame given by its pose in map.
+     * Voxels of the spatial index are culled or accepted as a whole,
+     * only points of voxels crossing the frustum boundary are tested.
+     * Cloud mutex is expected to be held.
+     */
+    std::vector<Index> frustum_indices(const SphericalProjection& model,
+                                       const Eigen::Isometry3f& cloud_to_map,
+                                       Value range) const
+    {
+        const Eigen::Isometry3f map_to_cloud = cloud_to_map.inverse(Eigen::Isometry);
+        const Vec3 origin = cloud_to_map.translation();
+        const auto index = this->index();
+        const Value voxel_size = index->voxel_size();
+        const Value block_radius = voxel_size * Value(std::sqrt(3.) / 2);
+        std::vector<Index> indices;
+        index->visit_voxels(origin.data(), range, [&](const Value* corner, const SpatialIndex::Bucket& bucket)
+        {
+            const Vec3 center = map_to_cloud * (ConstVec3Map(corner) + Vec3::Constant(voxel_size / 2));
+            const auto containment = model.classify(center, block_radius, range);
+            if (containment == SphericalProjection::OUTSIDE)
+            {
+                return;
+            }
+            if (containment == SphericalProjection::INSIDE)
+            {
+                indices.insert(indices.end(), bucket.begin(), bucket.end());
+                return;
+            }
+            for (const auto i: bucket)
+            {
+                const Vec3 q = map_to_cloud * ConstVec3Map(cloud_[i].position_);
+                if (model.contains(q(0), q(1), q(2), range))
+                {
+                    indices.push_back(i);
+                }
+            }
+        });
+        return indices;
+    }
+
+    /**
+     * Spherical projection of organized clouds from the sensor frame of the
+     * cloud, fitted once per sensor with rows tabulated per elevation bin,
+     * and refitted if the cloud size changes.
+     * @return Whether a projection is available.
+     */
+    bool sensor_projection(const sensor_msgs::PointCloud2& cloud, SphericalProjection& model)
+    {
+        Lock lock(projections_mutex_);
+        const auto it = sensor_projections_.find(cloud.header.frame_id);
+        if (it != sensor_projections_.end()
+                && it->second.height_ == cloud.height && it->second.width_ == cloud.width)
+        {
+            model = it->second;
+            return true;
+        }
+        Timer t;
+        if (!model.fit(cloud))
+        {
+            return false;
+        }
+        model.tabulate_rows(cloud);
+        sensor_projections_[cloud.header.frame_id] = model;
+        ROS_INFO("Projection of sensor %s fitted, %lu elevation bins (%.6f s).",
+                 cloud.header.frame_id.c_str(), model.rows_.size(), t.seconds_elapsed());
+        return true;
+    }
+
+    /**
+     * Local surface plane of organized cloud at the pixel point p projects to,
+     * through the pixel and its row and column neighbors toward p,
+     * with positive distance toward the sensor.
+     * @param p Point in cloud frame.
+     * @param pixel Pixel point p projects to.
+     * @return Whether p projects inside the cloud and the pixels are valid.
+     */
+    static bool scan_plane(const SphericalProjection& model,
+                           const sensor_msgs::PointCloud2& cloud,
+                           const sensor_msgs::PointCloud2ConstIterator<float>& x_begin,
+                           const Vec3& p, Vec4& plane, Index& pixel)
+    {
+        Value r, c;
+        model.lookup(p(0), p(1), p(2), r, c);
+        if (!(r >= 1 && r <= cloud.height - 2) || !(c >= 1 && c <= cloud.width - 2))
+        {
+            return false;
+        }
+        const int r0 = int(std::round(r));
+        const int c0 = int(std::round(c));
+        pixel = r0 * cloud.width + c0;
+        const Index i1 = (r >= r0 ? r0 + 1 : r0 - 1) * cloud.width + c0;
+        const Index i2 = r0 * cloud.width + (c >= c0 ? c0 + 1 : c0 - 1);
+
+        ConstVec3Map p0(&(x_begin + pixel)[0]);
+        if (!std::isfinite(p0(0)) || !std::isfinite(p0(1)) || !std::isfinite(p0(2)))
+            return false;
+        ConstVec3Map p1(&(x_begin + i1)[0]);
+        if (!std::isfinite(p1(0)) || !std::isfinite(p1(1)) || !std::isfinite(p1(2)))
+            return false;
+        ConstVec3Map p2(&(x_begin + i2)[0]);
+        if (!std::isfinite(p2(0)) || !std::isfinite(p2(1)) || !std::isfinite(p2(2)))
+            return false;
+        plane = plane_from_points(p0, p1, p2);
+
+        // Make sure positive distance is towards sensor at [0, 0, 0],
+        // i.e., outside from surface.
+        if (plane(3) < 0.)
+            plane *= -1;
+        return true;
+    }
+
+    /** Count point measured again, halving counters at max. */
+    void count_occupied(Index i)
+    {
+        // TODO: Param max occupancy sample size.
+        if (cloud_[i].num_occupied_ >= max_occ_counter_)
+        {
+            cloud_[i].num_occupied_ /= 2;
+            cloud_[i].num_empty_ /= 2;
+        }
+        ++cloud_[i].num_occupied_;
+    }
+
+    /** Count point seen through, halving counters at max. */
+    void count_empty(Index i)
+    {
+        if (cloud_[i].num_empty_ >= max_occ_counter_)
+        {
+            cloud_[i].num_occupied_ /= 2;
+            cloud_[i].num_empty_ /= 2;
+        }
+        ++cloud_[i].num_empty_;
+    }
+
+    /**
+     * Remove static points which turned empty, in a serial commit phase
+     * after parallel occupancy tests, marking their static neighbors dirty.
+     */
+    void remove_points(const std::vector<Index>& removed)
     {
-        if (cloud.width == 0)
+        Lock removed_lock(updated_mutex_);
+        Lock dirty_lock(dirty_mutex_);
+        // Neighbors removed together are not marked.
+        for (const auto i: removed)
         {
-            throw Exception("Zero cloud width.");
+            cloud_[i].flags_ &= ~STATIC;
         }
+        for (const auto i: removed)
+        {
+            // TODO: Change position to NaN to remove it from visualization?
+            // Don't update the point we remove.
+            dirty_indices_.erase(i);
+            for (Index k = 0; k < graph_[i].neighbor_count_; ++k)
+            {
+                const auto j = graph_[i].neighbors_[k];
+                // Don't add removed points.
+                if (!(cloud_[j].flags_ & STATIC))
+                {
+                    continue;
+                }
+                dirty_indices_.insert(j);
+            }
+            index()->removePoint(i);
+            updated_indices_.push_back(i);
+        }
+    }
+
+    void update_occupancy_projection(const sensor_msgs::PointCloud2& cloud,
+                                     const geometry_msgs::Transform& cloud_to_map_tf)
+    {
         Timer t;
         Timer t_part;
 
@@ -647,184 +962,114 @@ public:
             return;
         }
 
-        // TODO: Improve efficiency with camera model and cloud structure.
-        Eigen::Isometry3f cloud_to_map(tf2::transformToEigen(cloud_to_map_tf));
-        Eigen::Isometry3f map_to_cloud = cloud_to_map.inverse(Eigen::Isometry);
-
-        // Create sensor ray directions with an index.
         t_part.reset();
-        sensor_msgs::PointCloud2ConstIterator<float> x_begin(cloud, "x");
-//        flann::Matrix<float> cloud_mat(&cloud_begin[0], 1, 3, cloud.point_step);
-        std::vector<Value> dirs(3 * n_pts);
-        Value* dir_ptr = dirs.data();
-        for (auto x_it = x_begin; x_it != x_it.end(); ++x_it, dir_ptr += 3)
+        SphericalProjection model;
+        if (!sensor_projection(cloud, model))
         {
-            Vec3Map dir(dir_ptr);
-            dir = ConstVec3Map(&x_it[0]).normalized();
+            ROS_WARN("Could not fit cloud model (%.6f s).", t_part.seconds_elapsed());
+            return;
         }
-        FlannIndex dir_index(FlannMat(dirs.data(), n_pts, 3), flann::KDTreeSingleIndexParams());
-        dir_index.buildIndex();
-        ROS_INFO("%lu sensor rays and index created (%.6f s).", n_pts, t_part.seconds_elapsed());
 
-        // Find closest map points to sensor origin.
+        sensor_msgs::PointCloud2ConstIterator<float> x_begin(cloud, "x");
+        Eigen::Isometry3f cloud_to_map(tf2::transformToEigen(cloud_to_map_tf));
+        Eigen::Isometry3f map_to_cloud = cloud_to_map.inverse(Eigen::Isometry);
+
+        // Find map points in sensor field of view.
         Lock cloud_lock(cloud_mutex_);
-        Lock index_lock(index_mutex_);
-        Lock dirty_lock(dirty_mutex_);
         t_part.reset();
-        Vec3 origin = cloud_to_map.translation();
-        RadiusQuery<Value> q_map(*index_, FlannMat(origin.data(), 1, 3), 10.f);
-        ROS_INFO("%lu closest map points found (%.6f s).", q_map.nn_[0].size(), t_part.seconds_elapsed());
+        const auto nn = frustum_indices(model, cloud_to_map, 5.f);
+        ROS_DEBUG("%lu map points in field of view found (%.6f s).", nn.size(), t_part.seconds_elapsed());
 
-        // Test each map point, whether we can see through.
+        // Test each map point nearby, whether we can see through.
+        // Each point is updated by a single thread, removals are staged
+        // per thread and committed below, as they change neighbors too.
         t_part.reset();
-        std::vector<Index> nn_buf(1, INVALID_VERTEX);
-        std::vector<Value> dist_buf(1, std::numeric_limits<Value>::quiet_NaN());
-        flann::Matrix<Index> nn(nn_buf.data(), 1, 1);
-        flann::Matrix<Value> dist(dist_buf.data(), 1, 1);
-        flann::SearchParams params;
-        params.checks = 64;
-        params.cores = 0;
-        params.sorted = true;
-//        std::vector<Index> fan_nn(4, INVALID_VERTEX);
-//        std::vector<Value> fan_dist(4, std::numeric_limits<Value>::quiet_NaN());
-        typedef std::pair<Index, Value> IVP;
-        std::vector<IVP> fan(4, {INVALID_VERTEX, std::numeric_limits<Value>::quiet_NaN()});
-        // Comparator for descending order of second member.
-        const auto comp = [](const IVP& a, const IVP& b) { return a.second > b.second; };
-        Index n_occupied = 0;
-        Index n_empty = 0;
-        Index n_above = 0;
-        Index n_modified = 0;
-        for (const auto i: q_map.nn_[0])
+        size_t n_occupied = 0;
+        size_t n_empty = 0;
+        size_t n_occluded = 0;
+        const Value eps = points_min_dist_ / 2;
+        std::vector<Index> removed;
+        #pragma omp parallel reduction(+:n_occupied, n_empty, n_occluded)
         {
-//            ConstVec3Map p(cloud_[i].position_);
-            Vec3 p = map_to_cloud * ConstVec3Map(cloud_[i].position_);
-//            Vec3 dir = (map_to_cloud * p).normalized();
-            Vec3 dir = p.normalized();
-            dir_index.knnSearch(FlannMat(dir.data(), 1, 3), nn, dist, 1, params);
-            Index j = nn_buf[0];
-            Index r = j / cloud.width;
-            Index c = j % cloud.width;
-            // Seek containing triangle among incident ones.
-            // Test occlusion of the containing triangle.
-//            fan_nn[0] = (r > 0) ? ((r - 1) * cloud.width + c) : INVALID_VERTEX;
-//            fan_dist[0] = (fan_nn[0] != INVALID_VERTEX) ? : std::numeric_limits<Value>::infinity();
-            Index k = 0;
-            fan[k].first = r > 0
-                           ? (r - 1) * cloud.width + c
-                           : INVALID_VERTEX;
-            fan[k].second = fan[k].first != INVALID_VERTEX
-                            ? ConstVec3Map(&dirs[3 * fan[k].first]).dot(dir)
-                            : -std::numeric_limits<Value>::infinity();
-
-            ++k;
-            fan[k].first = c > 0
-                           ? r * cloud.width + c - 1
-                           : INVALID_VERTEX;
-            fan[k].second = fan[k].first != INVALID_VERTEX
-                            ? ConstVec3Map(&dirs[3 * fan[k].first]).dot(dir)
-                            : -std::numeric_limits<Value>::infinity();
-
-            ++k;
-            fan[k].first = c < cloud.width - 1
-                           ? r * cloud.width + c + 1
-                           : INVALID_VERTEX;
-            fan[k].second = fan[k].first != INVALID_VERTEX
-                            ? ConstVec3Map(&dirs[3 * fan[k].first]).dot(dir)
-                            : -std::numeric_limits<Value>::infinity();
-
-            ++k;
-            fan[k].first = r < cloud.height - 1
-                           ? (r + 1) * cloud.width + c
-                           : INVALID_VERTEX;
-            fan[k].second = fan[k].first != INVALID_VERTEX
-                            ? ConstVec3Map(&dirs[3 * fan[k].first]).dot(dir)
-                            : -std::numeric_limits<Value>::infinity();
-
-            // Sort nearby indices by cosine distance.
-            std::sort(fan.begin(), fan.end(), comp);
-            // Construct plane from three points of nearest directions.
-            // Test signed distance from the plane to assess occlusion.
-//            ConstVec3Map p0(&(x_begin + i)[0]);
-//            ConstVec3Map p1(&(x_begin + fan[0].first)[0]);
-//            ConstVec3Map p2(&(x_begin + fan[1].first)[0]);
-            // TODO: Orient normal.
-//            Vec3 n = (p1 - p0).cross(p2 - p0).normalized();
-//            Value d = -n.dot(p0);
-            Vec4 plane = plane_from_points(ConstVec3Map(&(x_begin + i)[0]),
-                                           ConstVec3Map(&(x_begin + fan[0].first)[0]),
-                                           ConstVec3Map(&(x_begin + fan[1].first)[0]));
-
-            // Make sure positive distance is towards sensor at [0, 0, 0],
-            // i.e., outside from surface.
-//            if (d < 0.)
-//            {
-//                n = -n;
-//                d = -d;
-//            }
-            if (plane(3) < 0.)
-            {
-                plane = -plane;
-            }
-//            Value signed_dist = n.dot(p) + d;
-            Value signed_dist = plane.dot(e2p(p));
-            Value eps = points_min_dist_ / Value(2.);
-            if (signed_dist > eps)
+            std::vector<Index> removed_local;
+            #pragma omp for schedule(dynamic, 256) nowait
+            for (size_t k = 0; k < nn.size(); ++k)
             {
-                // New point above surface.
-                ++n_above;
-            }
-            else if (signed_dist >= -eps)
-            {
-                // Known surface measured again.
-                if (cloud_[i].num_occupied_ == std::numeric_limits<decltype(cloud_[i].num_occupied_)>::max())
+                const auto i = nn[k];
+                cloud_[i].dist_to_plane_ = std::numeric_limits<Value>::quiet_NaN();
+                Vec3 p = map_to_cloud * ConstVec3Map(cloud_[i].position_);
+                Vec4 plane;
+                Index i0;
+                if (!scan_plane(model, cloud, x_begin, p, plane, i0))
+                    continue;
+
+                Value signed_dist = plane.dot(e2p(p));
+                cloud_[i].dist_to_plane_ = signed_dist;
+
+                if (signed_dist < -eps)
                 {
-                    cloud_[i].num_occupied_ /= 2;
-                    cloud_[i].num_empty_ /= 2;
+                    // Map point is occluded. Do nothing.
+                    ++n_occluded;
+                    continue;
                 }
-                ++cloud_[i].num_occupied_;
-                ++n_occupied;
-            }
-            else
-            {
-                // Known surface seen through,
-                // indicating it may be noise or it moved somewhere else.
-                if (cloud_[i].num_empty_ == std::numeric_limits<decltype(cloud_[i].num_empty_)>::max())
+
+                if (signed_dist < eps)
                 {
-                    cloud_[i].num_occupied_ /= 2;
-                    cloud_[i].num_empty_ /= 2;
+                    // Known surface measured again.
+                    count_occupied(i);
+                    ++n_occupied;
                 }
-                ++cloud_[i].num_empty_;
-                ++n_empty;
-            }
-            // TODO: Change point status and add to dirty indices if needed.
-            if (point_empty(cloud_[i]))
-            {
-                if (cloud_[i].flags_ & STATIC)
+                else
                 {
-                    cloud_[i].flags_ &= ~STATIC;
-                    dirty_indices_.insert(i);
-                    ++n_modified;
+                    // Known surface seen through,
+                    // indicating it may be noise or it moved somewhere else.
+
+                    // Check the incidence angle is not too high.
+                    Vec3 n = plane.head(3);
+                    const auto abs_cos = std::abs(ConstVec3Map(&(x_begin + i0)[0]).normalized().dot(n));
+                    if (abs_cos < min_empty_cos_)
+                    {
+                        continue;
+                    }
+
+                    count_empty(i);
+                    ++n_empty;
                 }
-            }
-            else
-            {
-                if (!(cloud_[i].flags_ & STATIC))
+
+                if (point_empty(cloud_[i]) && (cloud_[i].flags_ & STATIC))
                 {
-                    cloud_[i].flags_ |= STATIC;
-                    dirty_indices_.insert(i);
-                    ++n_modified;
+                    removed_local.push_back(i);
                 }
             }
+            #pragma omp critical
+            removed.insert(removed.end(), removed_local.begin(), removed_local.end());
         }
-        ROS_INFO("Occupancy of %lu points updated, %lu modified state, %lu above, %lu occupied, %lu empty (%.6f s).",
-                 q_map.nn_[0].size(), size_t(n_modified), size_t(n_above), size_t(n_occupied), size_t(n_empty),
-                 t_part.seconds_elapsed());
-        ROS_INFO("Occupancy updated (%.3f s).", t.seconds_elapsed());
+        const double t_test = t_part.seconds_elapsed();
+        std::sort(removed.begin(), removed.end());
+
+        // Commit removals, holding the remaining locks only briefly.
+        t_part.reset();
+        remove_points(removed);
+        ROS_INFO("Occupancy of %lu points updated, %lu modified state, %lu occluded, %lu occupied, %lu empty "
+                 "(%.6f s, commit %.6f s).",
+                 nn.size(), removed.size(), n_occluded, n_occupied, n_empty,
+                 t_test, t_part.seconds_elapsed());
     }
 
-    void update_occupancy_projection(const sensor_msgs::PointCloud2& cloud,
-                                     const geometry_msgs::Transform& cloud_to_map_tf)
+    /**
+     * Update occupancy of map points within range by depth lookups in the
+     * range image of an organized cloud.
+     *
+     * Points nearer than the near depth around their pixel are seen through,
+     * points up to the far depth are measured again, farther ones occluded.
+     * With block culling, voxels of the spatial index are tested first by
+     * depth bounds over their pixel footprints: occluded voxels are skipped
+     * and voxels in front of the scan are seen through without projecting
+     * their points.
+     */
+    void update_occupancy_range_image(const sensor_msgs::PointCloud2& cloud,
+                                      const geometry_msgs::Transform& cloud_to_map_tf,
+                                      Value range)
     {
         Timer t;
         Timer t_part;
@@ -836,184 +1081,184 @@ public:
         }
 
         assert(cloud.height > 1);
-        size_t n_pts = cloud.height * cloud.width;
-        if (n_pts == 0)
+        if (num_points(cloud) == 0)
         {
             ROS_INFO("No input points for updating occupancy.");
             return;
         }
 
-        t_part.reset();
         SphericalProjection model;
-        if (!model.fit(cloud))
+        if (!sensor_projection(cloud, model))
         {
             ROS_WARN("Could not fit cloud model (%.6f s).", t_part.seconds_elapsed());
             return;
         }
+        RangeImage image;
+        image.rasterize(cloud, model);
 
-        sensor_msgs::PointCloud2ConstIterator<float> x_begin(cloud, "x");
         Eigen::Isometry3f cloud_to_map(tf2::transformToEigen(cloud_to_map_tf));
         Eigen::Isometry3f map_to_cloud = cloud_to_map.inverse(Eigen::Isometry);
+        const Vec3 origin = cloud_to_map.translation();
+        const Value tol = occupancy_depth_tolerance_;
 
-        // Find closest map points to sensor origin.
+        // Collect points within range by voxels, culling whole voxels.
         Lock cloud_lock(cloud_mutex_);
-        Lock index_lock(index_mutex_);
         t_part.reset();
-        Vec3 origin = cloud_to_map.translation();
-        RadiusQuery<Value> q_map(*index_, FlannMat(origin.data(), 1, 3), 5.f);
-        ROS_DEBUG("%lu closest map points found (%.6f s).", q_map.nn_[0].size(), t_part.seconds_elapsed());
-
-        Lock removed_lock(updated_mutex_);
-        Lock dirty_lock(dirty_mutex_);
-        // Test each map point nearby, whether we can see through.
-        Index n_occupied = 0;
-        Index n_empty = 0;
-        Index n_occluded = 0;
-        Index n_modified = 0;
-        const Value eps = points_min_dist_ / 2;
-        for (const auto i: q_map.nn_[0])
+        enum { TEST, FRONT };
+        std::vector<Index> points;
+        std::vector<size_t> block_begin;
+        std::vector<uint8_t> block_state;
+        size_t n_occluded_blocks = 0;
+        const auto index = this->index();
+        const Value voxel_size = index->voxel_size();
+        const Value block_radius = voxel_size * Value(std::sqrt(3.) / 2);
+        index->visit_voxels(origin.data(), range, [&](const Value* corner, const SpatialIndex::Bucket& bucket)
         {
-            cloud_[i].dist_to_plane_ = std::numeric_limits<Value>::quiet_NaN();
-            Vec3 p = map_to_cloud * ConstVec3Map(cloud_[i].position_);
-            Value r, c;
-            model.project(p(0), p(1), p(2), r, c);
-
-            if (r < 1 || r > cloud.height - 2)
-                continue;
-            int r0 = int(std::round(r));
-
-            if (c < 1 || c > cloud.width - 2)
-                continue;
-            int c0 = int(std::round(c));
-
-            Index i0 = r0 * cloud.width + c0;
-
-            Value rint;
-            Index i1 = std::modf(r, &rint) >= Value(0)
-                       ? (r0 + 1) * cloud.width + c0
-                       : (r0 - 1) * cloud.width + c0;
-
-            Value cint;
-            Index i2 = std::modf(c, &cint) >= Value(0)
-                       ? r0 * cloud.width + c0 + 1
-                       : r0 * cloud.width + c0 - 1;
-
-            ConstVec3Map p0(&(x_begin + i0)[0]);
-            if (!std::isfinite(p0(0)) || !std::isfinite(p0(1)) || !std::isfinite(p0(2)))
-                continue;
-            ConstVec3Map p1(&(x_begin + i1)[0]);
-            if (!std::isfinite(p1(0)) || !std::isfinite(p1(1)) || !std::isfinite(p1(2)))
-                continue;
-            ConstVec3Map p2(&(x_begin + i2)[0]);
-            if (!std::isfinite(p2(0)) || !std::isfinite(p2(1)) || !std::isfinite(p2(2)))
-                continue;
-            Vec4 plane = plane_from_points(p0, p1, p2);
-
-            // Make sure positive distance is towards sensor at [0, 0, 0],
-            // i.e., outside from surface.
-            if (plane(3) < 0.)
-                plane *= -1;
-
-            Value signed_dist = plane.dot(e2p(p));
-            cloud_[i].dist_to_plane_ = signed_dist;
-
-            if (signed_dist < -eps)
+            const Vec3 center = ConstVec3Map(corner) + Vec3::Constant(voxel_size / 2);
+            const Vec3 q = map_to_cloud * center;
+            const auto containment = model.classify(q, block_radius, range);
+            if (containment == SphericalProjection::OUTSIDE)
             {
-                // Map point is occluded. Do nothing.
-                ++n_occluded;
-                continue;
+                return;
             }
-
-            if (signed_dist < eps)
+            const Value dist = q.norm();
+            uint8_t state = TEST;
+            int r0, c0, r1, c1;
+            if (occupancy_block_culling_ && footprint(model, image, q, block_radius, r0, c0, r1, c1))
             {
-                // Known surface measured again.
-                // TODO: Param max occupancy sample size.
-//                if (cloud_[i].num_occupied_ == std::numeric_limits<decltype(cloud_[i].num_occupied_)>::max())
-                if (cloud_[i].num_occupied_ >= max_occ_counter_)
+                Value near, far;
+                image.bounds(r0, c0, r1, c1, near, far);
+                if (dist - block_radius > far + tol)
                 {
-                    cloud_[i].num_occupied_ /= 2;
-                    cloud_[i].num_empty_ /= 2;
+                    ++n_occluded_blocks;
+                    return;
                 }
-                ++cloud_[i].num_occupied_;
-                ++n_occupied;
-            }
-            else
-            {
-                // Known surface seen through,
-                // indicating it may be noise or it moved somewhere else.
-
-                // Check the incidence angle is not too high.
-                Vec3 n = plane.head(3);
-                const auto abs_cos = std::abs(p0.normalized().dot(n));
-                if (abs_cos < min_empty_cos_)
+                if (dist + block_radius < near - tol)
                 {
-                    continue;
+                    state = FRONT;
                 }
-
-                if (cloud_[i].num_empty_ >= max_occ_counter_)
+            }
+            block_begin.push_back(points.size());
+            block_state.push_back(state);
+            if (containment == SphericalProjection::INSIDE)
+            {
+                points.insert(points.end(), bucket.begin(), bucket.end());
+                return;
+            }
+            for (const auto i: bucket)
+            {
+                const Vec3 p = map_to_cloud * ConstVec3Map(cloud_[i].position_);
+                if (model.contains(p(0), p(1), p(2), range))
                 {
-                    cloud_[i].num_occupied_ /= 2;
-                    cloud_[i].num_empty_ /= 2;
+                    points.push_back(i);
                 }
-                ++cloud_[i].num_empty_;
-                ++n_empty;
             }
+        });
+        block_begin.push_back(points.size());
+        const double t_cull = t_part.seconds_elapsed();
 
-            // TODO: Change point status and add to dirty indices if needed.
-            if (point_empty(cloud_[i]))
+        // Test points of remaining blocks in parallel, stage removals.
+        t_part.reset();
+        size_t n_occupied = 0;
+        size_t n_empty = 0;
+        size_t n_occluded = 0;
+        std::vector<Index> removed;
+        #pragma omp parallel reduction(+:n_occupied, n_empty, n_occluded)
+        {
+            std::vector<Index> removed_local;
+            #pragma omp for schedule(dynamic, 16) nowait
+            for (size_t b = 0; b < block_state.size(); ++b)
             {
-                if (cloud_[i].flags_ & STATIC)
+                for (size_t k = block_begin[b]; k < block_begin[b + 1]; ++k)
                 {
-                    cloud_[i].flags_ &= ~STATIC;
-                    // TODO: Change position to NaN to remove it from visualization?
-//                    cloud_[i].position_[0] = std::numeric_limits<Value>::quiet_NaN();
-//                    cloud_[i].position_[1] = std::numeric_limits<Value>::quiet_NaN();
-//                    cloud_[i].position_[2] = std::numeric_limits<Value>::quiet_NaN();
-                    // Don't update the point we remove.
-                    dirty_indices_.erase(i);
-                    // TODO: Add neighborhood to dirty.
-                    for (const auto j: graph_[i].neighbors_)
+                    const auto i = points[k];
+                    if (block_state[b] == TEST)
                     {
-                        // Don't add removed points.
-                        if (!(cloud_[j].flags_ & STATIC))
+                        const Vec3 q = map_to_cloud * ConstVec3Map(cloud_[i].position_);
+                        int r, c;
+                        if (!image.pixel(model, q(0), q(1), q(2), r, c))
                         {
                             continue;
                         }
-                        dirty_indices_.insert(j);
+                        const Value dist = q.norm();
+                        if (!(dist < image.near(r, c) - tol))
+                        {
+                            if (std::isfinite(image.far(r, c)) && dist <= image.far(r, c) + tol)
+                            {
+                                count_occupied(i);
+                                ++n_occupied;
+                            }
+                            else
+                            {
+                                ++n_occluded;
+                            }
+                            continue;
+                        }
+                    }
+                    count_empty(i);
+                    ++n_empty;
+                    if (point_empty(cloud_[i]) && (cloud_[i].flags_ & STATIC))
+                    {
+                        removed_local.push_back(i);
                     }
-                    index_->removePoint(i);
-                    updated_indices_.push_back(i);
-                    ++n_modified;
                 }
             }
-//            else
-//            {
-//                if (false && !(cloud_[i].flags_ & STATIC))
-//                {
-//                    // Don't resurrect removed points.
-//                    if (!std::isfinite(cloud_[i].position_[0]))
-//                    {
-//                        continue;
-//                    }
-//                    cloud_[i].flags_ |= STATIC;
-//                    dirty_indices_.insert(i);
-//                    // TODO: Add neighborhood to dirty.
-//                    for (const auto j: graph_[i].neighbors_)
-//                    {
-//                        // Don't add removed points.
-//                        if (!(cloud_[j].flags_ & STATIC))
-//                        {
-//                            continue;
-//                        }
-//                        dirty_indices_.insert(j);
-//                    }
-//                    ++n_modified;
-//                }
-//            }
+            #pragma omp critical
+            removed.insert(removed.end(), removed_local.begin(), removed_local.end());
         }
-        ROS_INFO("Occupancy of %lu points updated, %lu modified state, %lu occluded, %lu occupied, %lu empty (%.6f s).",
-                 q_map.nn_[0].size(), size_t(n_modified), size_t(n_occluded), size_t(n_occupied), size_t(n_empty),
-                 t_part.seconds_elapsed());
+        const double t_test = t_part.seconds_elapsed();
+        std::sort(removed.begin(), removed.end());
+
+        t_part.reset();
+        remove_points(removed);
+        ROS_INFO("Occupancy of %lu points in %lu blocks (%lu occluded blocks skipped, %.6f s) updated, "
+                 "%lu modified state, %lu occluded, %lu occupied, %lu empty (%.6f s, commit %.6f s).",
+                 points.size(), block_state.size(), n_occluded_blocks, t_cull,
+                 removed.size(), n_occluded, n_occupied, n_empty, t_test, t_part.seconds_elapsed());
+    }
+
+    /**
+     * Pixel rectangle covering a ball in sensor frame, false if not bounded
+     * or not inside the image.
+     */
+    static bool footprint(const SphericalProjection& model, const RangeImage& image,
+                          const Vec3& q, Value radius, int& r0, int& c0, int& r1, int& c1)
+    {
+        const Value dist = q.norm();
+        if (!(dist > radius))
+        {
+            return false;
+        }
+        // Angular radius of the ball and its azimuth extent.
+        const Value a = std::asin(radius / dist);
+        const Value elevation = fast_inclination(q(0), q(1), q(2));
+        if (!(std::sin(a) < std::cos(elevation)))
+        {
+            return false;
+        }
+        const Value da = std::asin(std::sin(a) / std::cos(elevation));
+        const Value azimuth = std::atan2(q(1), q(0));
+        if (azimuth - da < -Value(M_PI) || azimuth + da > Value(M_PI))
+        {
+            return false;
+        }
+        const Value ra = model.row(elevation - a);
+        const Value rb = model.row(elevation + a);
+        const Value ca = model.column(azimuth - da);
+        const Value cb = model.column(azimuth + da);
+        const Value r_min = std::floor(std::min(ra, rb));
+        const Value r_max = std::ceil(std::max(ra, rb));
+        const Value c_min = std::floor(std::min(ca, cb));
+        const Value c_max = std::ceil(std::max(ca, cb));
+        if (!(r_min >= 0 && r_max < image.height() && c_min >= 0 && c_max < image.width()))
+        {
+            return false;
+        }
+        r0 = int(r_min);
+        r1 = int(r_max);
+        c0 = int(c_min);
+        c1 = int(c_max);
+        return true;
     }
 
     void update_occupancy_unorganized(const flann::Matrix<Elem>& points, const flann::Matrix<Elem>& origin)
@@ -1044,7 +1289,7 @@ public:
 
         // Get map points nearby to check.
         Elem nearby_dist = 25.;
-        RadiusQuery<Value> q_nearby(*index_, origin, nearby_dist);
+        RadiusQuery<Value> q_nearby(*index(), origin, nearby_dist);
         Index n_nearby = q_nearby.nn_[0].size();
         ROS_DEBUG("Found %u points up to %.1f m from sensor (%.3f s).",
                   n_nearby, nearby_dist, t_dyn.seconds_elapsed());
@@ -1132,7 +1377,7 @@ public:
                 const Elem d_map = (x_map - x_origin).norm();
                 // TODO: To be usable as this normal must have correct orientation.
 //                    ConstVec3Map n_map(normals_[v_map]);
-                ConstVec3Map n_map(normal(v_map));
+                const Vec3 n_map = normal(v_map);
 //                    Elem level = n_map.dot(x_new - x_map);
 //                    if (d_new > d_map && level < 0.)
                 Elem cos = n_map.dot(ConstVec3Map(dirs[v_new]));
@@ -1178,9 +1423,11 @@ public:
 //        ROS_INFO("Neighborhood size: %lu bytes.", sizeof(Neighborhood));
         Lock cloud_lock(cloud_mutex_);
         assert(cloud_.empty());
-        Lock index_lock(index_mutex_);
         Lock dirty_lock(dirty_mutex_);
         Timer t;
+        coarse_graph_.clear();
+        dirty_indices_.reserve(cloud_.size() + points.rows);
+        cost_updates_.reserve(cloud_.size() + points.rows);
         for (size_t i = 0; i < points.rows; ++i)
         {
             dirty_indices_.insert(static_cast<Index>(cloud_.size()));
@@ -1191,13 +1438,9 @@ public:
 //            point.flags_ &= ~UPDATED;
 //            cloud_.emplace_back(point);
             cloud_.push_back(point);
-
-            Neighborhood neigh;
-            std::copy(points[i], points[i] + points.cols, neigh.position_);
-//            neigh.neighbor_count_ = 0;
-//            graph_.emplace_back(neigh);
-            graph_.push_back(neigh);
         }
+        // Neighbors are found once the index is updated.
+        graph_.resize(cloud_.size());
         assert(cloud_.size() == points.rows);
         ROS_DEBUG("%lu dirty indices.", dirty_indices_.size());
 //        ROS_INFO("Map initialized with %lu points.", points.rows);
@@ -1208,8 +1451,36 @@ public:
                  t.seconds_elapsed());
     }
 
+    /**
+     * Find neighbors of points to merge without locking the cloud, so that
+     * the search can overlap with planning. Points removed meanwhile are
+     * skipped in merge, which searches again if points were added or the
+     * index was rebuilt.
+     */
+    MergeNeighbors merge_neighbors(const flann::Matrix<Elem>& points) const
+    {
+        Timer t;
+        MergeNeighbors neighbors;
+        neighbors.index = index();
+        if (!neighbors.index)
+        {
+            return neighbors;
+        }
+        neighbors.num_added = neighbors.index->num_added();
+        neighbors.query.reset(new Query<Elem>(*neighbors.index, points,
+                                              Neighborhood::K_NEIGHBORS, neighborhood_radius_));
+        ROS_DEBUG("Got neighbors for %lu points (%.3f s).", points.rows, t.seconds_elapsed());
+        return neighbors;
+    }
+
 //        void merge(flann::Matrix<Elem> points, flann::Matrix<Elem> origin)
     void merge(const flann::Matrix<Elem>& points, const flann::Matrix<Elem>& origin)
+    {
+        merge(points, origin, MergeNeighbors());
+    }
+
+    void merge(const flann::Matrix<Elem>& points, const flann::Matrix<Elem>& origin,
+               MergeNeighbors neighbors)
     {
         Timer t;
         ROS_DEBUG("Merging cloud started. Capacity %lu points.", capacity());
@@ -1228,14 +1499,14 @@ public:
         // Move it in a calling method where we have cloud structure.
 //        update_occupancy_unorganized(points, origin);
 
-        // Find NN distance within current map.
-//        Lock index_lock(index_mutex_);
+        // Find NN distance within current map, unless found already.
         Lock cloud_lock(cloud_mutex_);
-        Lock index_lock(index_mutex_);
-        Query<Elem> q(*index_, points, Neighborhood::K_NEIGHBORS, neighborhood_radius_);
-        ROS_DEBUG("Got neighbors for %lu points (%.3f s).",
-                  points.rows,
-                  t.seconds_elapsed());
+        const auto index = this->index();
+        if (!neighbors.query || neighbors.index != index || neighbors.num_added != index->num_added())
+        {
+            neighbors = merge_neighbors(points);
+        }
+        const auto& q = *neighbors.query;
 
         // Merge points with distance to NN higher than threshold.
         // We'll assume that input points also (approx.) comply to the
@@ -1243,6 +1514,8 @@ public:
         // separately.
         Lock added_lock(updated_mutex_);
         Lock dirty_lock(dirty_mutex_);
+        dirty_indices_.reserve(cloud_.size() + points.rows);
+        cost_updates_.reserve(cloud_.size() + points.rows);
         Index start = static_cast<Index>(size());
         for (Index i = 0; i < points.rows; ++i)
         {
@@ -1287,16 +1560,15 @@ public:
                 // TODO: Or only increment occupied flag?
                 point.flags_ |= STATIC;
                 cloud_.push_back(point);
-
-                Neighborhood neigh;
-                std::copy(points[i], points[i] + points.cols, neigh.position_);
-                graph_.push_back(neigh);
             }
         }
+        graph_.resize(cloud_.size());
 
-        // TODO: Rebuild index time to time, don't wait till it doubles in size.
-        float rebuild_threshold = (index_->size() + 1000.f) / index_->size();
-        index_->addPoints(position_matrix(start), rebuild_threshold);
+        // Insert new points into the index, no rebuild needed.
+        if (Index(size()) > start)
+        {
+            index->addPoints(position_matrix(start));
+        }
 
         ROS_INFO("%lu points merged into map with %lu points (%.3f s).",
                  size_t(size() - start),
@@ -1304,6 +1576,10 @@ public:
                  t.seconds_elapsed());
     }
 
+    /**
+     * Describe published point fields within Point layout. Fields not stored
+     * in compact points are skipped and left as padding.
+     */
     void initialize_cloud(sensor_msgs::PointCloud2& cloud)
     {
         cloud.point_step = uint32_t(offsetof(Point, position_));
@@ -1316,12 +1592,15 @@ public:
         append_field<decltype(Point().normal_[0])>("normal_y", 1, cloud);
         append_field<decltype(Point().normal_[0])>("normal_z", 1, cloud);
 
+#ifndef NAEX_COMPACT
         cloud.point_step = uint32_t(offsetof(Point, normal_support_));
         append_field<decltype(Point().normal_support_)>("normal_support", 1, cloud);
+#endif
 
         cloud.point_step = uint32_t(offsetof(Point, ground_diff_std_));
         append_field<decltype(Point().ground_diff_std_)>("ground_diff_std", 1, cloud);
 
+#ifndef NAEX_COMPACT
         cloud.point_step = uint32_t(offsetof(Point, min_ground_diff_));
         append_field<decltype(Point().min_ground_diff_)>("min_ground_diff", 1, cloud);
 
@@ -1335,6 +1614,7 @@ public:
         append_field<decltype(Point().viewpoint_[0])>("viewpoint_x", 1, cloud);
         append_field<decltype(Point().viewpoint_[0])>("viewpoint_y", 1, cloud);
         append_field<decltype(Point().viewpoint_[0])>("viewpoint_z", 1, cloud);
+#endif
 
         cloud.point_step = uint32_t(offsetof(Point, dist_to_actor_));
         append_field<decltype(Point().dist_to_actor_)>("dist_to_actor", 1, cloud);
@@ -1366,11 +1646,13 @@ public:
         cloud.point_step = uint32_t(offsetof(Point, num_occupied_));
         append_field<decltype(Point().num_occupied_)>("num_occupied", 1, cloud);
 
+#ifndef NAEX_COMPACT
         cloud.point_step = uint32_t(offsetof(Point, dist_to_plane_));
         append_field<decltype(Point().dist_to_plane_)>("dist_to_plane", 1, cloud);
 
         cloud.point_step = uint32_t(offsetof(Point, num_obstacle_pts_));
         append_field<decltype(Point().num_obstacle_pts_)>("num_obstacle_pts", 1, cloud);
+#endif
 
         cloud.point_step = uint32_t(offsetof(Point, num_obstacle_neighbors_));
         append_field<decltype(Point().num_obstacle_neighbors_)>("num_obstacle_neighbors", 1, cloud);
@@ -1384,8 +1666,10 @@ public:
         cloud.point_step = uint32_t(offsetof(Point, reward_));
         append_field<decltype(Point().reward_)>("reward", 1, cloud);
 
+#ifndef NAEX_COMPACT
         cloud.point_step = uint32_t(offsetof(Point, relative_cost_));
         append_field<decltype(Point().relative_cost_)>("relative_cost", 1, cloud);
+#endif
 
         cloud.point_step = uint32_t(sizeof(Point));
     }
@@ -1396,14 +1680,8 @@ public:
         sensor_msgs::PointCloud2Modifier modifier(cloud);
         Lock cloud_lock(cloud_mutex_);
         modifier.resize(cloud_.size());
-//        std::copy(&cloud_.front(), &cloud_.back(), &cloud.data.front());
-//        std::copy(cloud_.begin(), cloud_.end(), cloud.data.begin());
-//        std::copy(cloud_.begin(), cloud_.end(), reinterpret_cast<Point*>(&cloud.data[0]));
-        const auto from = reinterpret_cast<const uint8_t*>(cloud_.data());
-        const auto to = reinterpret_cast<const uint8_t*>(cloud_.data() + cloud_.size());
-        auto out = cloud.data.data();
-        assert((to - from) == cloud.data.size());
-        std::copy(from, to, out);
+        assert(cloud_.size() * sizeof(Point) == cloud.data.size());
+        write_points(cloud_, cloud.data.data());
     }
 
     template<typename C>
@@ -1422,8 +1700,7 @@ public:
         Lock cloud_lock(cloud_mutex_);
         for (auto it = indices.begin(); it != indices.end(); ++it, out += cloud.point_step)
         {
-            const auto from = reinterpret_cast<uint8_t*>(&cloud_[*it]);
-            std::copy(from, from + cloud.point_step, out);
+            write_point(cloud_, *it, out);
         }
     }
 
@@ -1478,23 +1755,40 @@ public:
         return cloud_.empty();
     }
 
+    /** Current index snapshot, safe to query concurrently without locks. */
+    std::shared_ptr<SpatialIndex> index() const
+    {
+        return std::atomic_load(&index_);
+    }
+
     // Lock mutexes in this sequence
-    // cloud_mutex_, index_mutex_, dirty_mutex_.
-    // to avoid deadlocks.
+    // cloud_mutex_, updated_mutex_, dirty_mutex_.
+    // to avoid deadlocks. The index needs no locking.
 
     mutable Mutex cloud_mutex_;
-    std::vector<Point> cloud_{};
-    std::vector<Neighborhood> graph_{};
+    Cloud cloud_{};
+    NeighborGraph graph_{};
 
-    mutable Mutex index_mutex_;
-    std::shared_ptr<flann::Index<flann::L2_3D<Value>>> index_;
+    // Index is synchronized internally and rebuilds are published
+    // atomically, access it via index().
+    std::shared_ptr<SpatialIndex> index_;
 
     mutable Mutex updated_mutex_;
     std::vector<Index> updated_indices_{};
 
+    // Points can be marked dirty concurrently, dirty_mutex_ separates
+    // marking from consuming and clearing.
     mutable Mutex dirty_mutex_;
 //    std::set<Index> dirty_indices_;
-    std::unordered_set<Index> dirty_indices_{};
+    DirtySet dirty_indices_{};
+    // Vertices with recomputed edge costs, for incremental planning.
+    DirtySet cost_updates_{};
+    // Voxel super-nodes over traversable points, updated with dirty points.
+    CoarseGraph coarse_graph_{};
+
+    // Projections of organized clouds per sensor frame.
+    mutable Mutex projections_mutex_;
+    std::unordered_map<std::string, SphericalProjection> sensor_projections_{};
 
     // Map parameters
     float points_min_dist_{0.2};
@@ -1503,10 +1797,18 @@ public:
     int min_num_empty_{2};
     float min_empty_ratio_{1.0};
     int max_occ_counter_{7};
+    // Depth tolerance of range image occupancy.
+    float occupancy_depth_tolerance_{0.1};
+    // Test whole voxels against range image depth bounds first.
+    bool occupancy_block_culling_{true};
 
     // Graph
 //    int neighbor
     float neighborhood_radius_{0.6};
+    // Voxel size of the spatial index, close to query radius works best.
+    float index_voxel_size_{0.6};
+    // Voxel size of coarse graph nodes, zero to disable the coarse graph.
+    float coarse_voxel_size_{0.0};
 //    float traversable_radius_;
     // Traversability
     float edge_min_centroid_offset_{0.5};
@@ -1523,6 +1825,8 @@ public:
     float max_pitch_{30. / 180. * M_PI};
     float max_roll_{30. / 180. * M_PI};
     float inclination_penalty_{1.0};
+    // Compute edge costs on first access in planning instead of in update.
+    bool lazy_edge_costs_{false};
 };
 
 /** https://www.boost.org/doc/libs/1_75_0/libs/graph/doc/adjacency_list.html */
@@ -1539,7 +1843,6 @@ public:
     /** Returns the number of edges in the graph g. */
     inline Edge num_edges() const
     {
-        // TODO: Compute true number based on valid neighbors.
         return map_.num_edges();
     }
     inline std::pair<VertexIter, VertexIter> vertices() const
@@ -1548,22 +1851,16 @@ public:
     }
     inline std::pair<EdgeIter, EdgeIter> out_edges(const Vertex& u) const
     {
-        // TODO: Limit to valid edges here or just by costs?
         return map_.out_edges(u);
     }
     inline Edge out_degree(const Vertex& u) const
     {
-        // TODO: Compute true number based on valid neighbors.
         return map_.out_degree(u);
     }
     inline Vertex source(const Edge& e) const
     {
         return map_.source(e);
     }
-    inline Vertex target_index(const Edge& e) const
-    {
-        return map_.target_index(e);
-    }
     inline Vertex target(const Edge& e) const
     {
         return map_.target(e);
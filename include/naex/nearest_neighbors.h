@@ -126,7 +126,9 @@ template<typename T>
 class Query
 {
 public:
-    Query(const flann::Index<flann::L2_3D<T>>& index,
+    /** KNN or radius-bounded KNN query, index being flann::Index or VoxelIndex. */
+    template<typename I>
+    Query(const I& index,
           const flann::Matrix<T>& queries,
 //          const flann::Matrix<const T>& queries,
           const int k = 1,
@@ -160,7 +162,8 @@ template<typename T>
 class RadiusQuery
 {
 public:
-    RadiusQuery(const flann::Index<flann::L2_3D<T>>& index,
+    template<typename I>
+    RadiusQuery(const I& index,
                 const flann::Matrix<T>& queries,
                 T radius,
                 int checks = 32):
@@ -0,0 +1,244 @@
+#ifndef NAEX_NEIGHBOR_GRAPH_H
+#define NAEX_NEIGHBOR_GRAPH_H
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <naex/types.h>
+#include <type_traits>
+#include <vector>
+
+namespace naex
+{
+
+/**
+ * Reference to a vertex neighborhood stored in NeighborGraph.
+ *
+ * Provides neighbor_count_ and neighbors_, distances_, and costs_ arrays
+ * of that length, so that code iterating neighbors works with row views.
+ *
+ * @tparam Const Whether the referenced neighborhood is read-only.
+ */
+template<bool Const>
+class NeighborhoodRefT
+{
+public:
+    typedef typename std::conditional<Const, const Value, Value>::type V;
+    typedef typename std::conditional<Const, const Index, Index>::type I;
+
+    template<typename G>
+    NeighborhoodRefT(G& graph, Vertex v):
+        neighbor_count_(graph.vertices_[v].neighbor_count_),
+        neighbors_(graph.targets_.data() + graph.vertices_[v].begin_),
+        distances_(graph.distances_.data() + graph.vertices_[v].begin_),
+        costs_(graph.costs_.data() + graph.vertices_[v].begin_)
+    {}
+
+    I& neighbor_count_;
+    I* neighbors_;
+    V* distances_;
+    V* costs_;
+};
+
+typedef NeighborhoodRefT<false> NeighborhoodRef;
+typedef NeighborhoodRefT<true> ConstNeighborhoodRef;
+
+/**
+ * Neighbor graph in compressed sparse row format.
+ *
+ * Each vertex stores only its valid neighbors in a contiguous range of edge
+ * slots, the first neighbor being the vertex itself. Edge descriptors are
+ * slot indices. Vertices keep some slack for updates, a vertex outgrowing
+ * its slots is moved to the end, and the holes left behind are reclaimed by
+ * compact(), which invalidates edge descriptors.
+ */
+class NeighborGraph
+{
+public:
+    typedef NeighborhoodRef reference;
+    typedef ConstNeighborhoodRef const_reference;
+
+    /** Number of slots to reserve for a vertex with n neighbors. */
+    static Index slot_capacity(Index n)
+    {
+        return std::min(Index(Neighborhood::K_NEIGHBORS), n + n / 4 + 1);
+    }
+
+    size_t size() const
+    {
+        return vertices_.size();
+    }
+
+    bool empty() const
+    {
+        return vertices_.empty();
+    }
+
+    size_t capacity() const
+    {
+        return vertices_.capacity();
+    }
+
+    void reserve(size_t n)
+    {
+        vertices_.reserve(n);
+    }
+
+    void clear()
+    {
+        vertices_.clear();
+        targets_.clear();
+        distances_.clear();
+        costs_.clear();
+        sources_.clear();
+        num_edges_ = 0;
+        num_free_ = 0;
+    }
+
+    /** Add or remove vertices, new ones having no neighbors. */
+    void resize(size_t n)
+    {
+        while (vertices_.size() > n)
+        {
+            release(Vertex(vertices_.size() - 1));
+            vertices_.pop_back();
+        }
+        vertices_.resize(n);
+    }
+
+    NeighborhoodRef operator[](Vertex v)
+    {
+        return NeighborhoodRef(*this, v);
+    }
+
+    ConstNeighborhoodRef operator[](Vertex v) const
+    {
+        return ConstNeighborhoodRef(*this, v);
+    }
+
+    /**
+     * Replace neighbors of vertex v, invalidating their edge costs.
+     * The first neighbor is expected to be the vertex itself.
+     */
+    void set_neighbors(Vertex v, const Index* neighbors, const Value* distances, Index n)
+    {
+        assert(n <= Neighborhood::K_NEIGHBORS);
+        auto& row = vertices_[v];
+        if (n > row.capacity_)
+        {
+            release(v);
+            row.begin_ = Edge(targets_.size());
+            row.capacity_ = slot_capacity(n);
+            targets_.resize(targets_.size() + row.capacity_, INVALID_VERTEX);
+            distances_.resize(targets_.size(), std::numeric_limits<Value>::quiet_NaN());
+            costs_.resize(targets_.size(), std::numeric_limits<Value>::quiet_NaN());
+            sources_.resize(targets_.size(), v);
+        }
+        num_edges_ += degree(n) - degree(row.neighbor_count_);
+        row.neighbor_count_ = n;
+        std::copy(neighbors, neighbors + n, targets_.data() + row.begin_);
+        std::copy(distances, distances + n, distances_.data() + row.begin_);
+        std::fill(costs_.data() + row.begin_, costs_.data() + row.begin_ + n,
+                  std::numeric_limits<Value>::quiet_NaN());
+    }
+
+    /** Number of out edges, i.e., neighbors excluding the vertex itself. */
+    Edge num_edges() const
+    {
+        return num_edges_;
+    }
+
+    /** Number of edge slots, including slack and holes. */
+    Edge num_slots() const
+    {
+        return Edge(targets_.size());
+    }
+
+    /** Whether holes occupy most of the edge slots. */
+    bool fragmented() const
+    {
+        return 2 * num_free_ > num_slots();
+    }
+
+    /** Reclaim holes, invalidates edge descriptors but not costs. */
+    void compact()
+    {
+        std::vector<Index> targets;
+        std::vector<Value> distances;
+        std::vector<Value> costs;
+        std::vector<Vertex> sources;
+        const size_t n = num_slots() - num_free_;
+        targets.reserve(n);
+        distances.reserve(n);
+        costs.reserve(n);
+        sources.reserve(n);
+        for (Vertex v = 0; v < Vertex(vertices_.size()); ++v)
+        {
+            auto& row = vertices_[v];
+            const Edge begin = row.begin_;
+            row.begin_ = Edge(targets.size());
+            targets.insert(targets.end(), targets_.data() + begin, targets_.data() + begin + row.capacity_);
+            distances.insert(distances.end(), distances_.data() + begin, distances_.data() + begin + row.capacity_);
+            costs.insert(costs.end(), costs_.data() + begin, costs_.data() + begin + row.capacity_);
+            sources.insert(sources.end(), size_t(row.capacity_), v);
+        }
+        targets_.swap(targets);
+        distances_.swap(distances);
+        costs_.swap(costs);
+        sources_.swap(sources);
+        num_free_ = 0;
+    }
+
+    inline Edge out_begin(Vertex u) const
+    {
+        // Skip the first neighbor - the vertex itself.
+        return vertices_[u].begin_ + std::min(vertices_[u].neighbor_count_, Index(1));
+    }
+    inline Edge out_end(Vertex u) const
+    {
+        return vertices_[u].begin_ + vertices_[u].neighbor_count_;
+    }
+    inline Edge out_degree(Vertex u) const
+    {
+        return degree(vertices_[u].neighbor_count_);
+    }
+    inline Vertex source(Edge e) const
+    {
+        return sources_[e];
+    }
+    inline Vertex target(Edge e) const
+    {
+        return targets_[e];
+    }
+
+    std::vector<Neighborhood> vertices_{};
+    // Edge arrays indexed by edge descriptors.
+    std::vector<Index> targets_{};
+    std::vector<Value> distances_{};
+    std::vector<Value> costs_{};
+    std::vector<Vertex> sources_{};
+
+private:
+    static Edge degree(Index neighbor_count)
+    {
+        return std::max(neighbor_count - 1, Index(0));
+    }
+
+    /** Release slots of vertex v, leaving a hole. */
+    void release(Vertex v)
+    {
+        auto& row = vertices_[v];
+        num_edges_ -= degree(row.neighbor_count_);
+        num_free_ += row.capacity_;
+        std::fill(sources_.data() + row.begin_, sources_.data() + row.begin_ + row.capacity_, INVALID_VERTEX);
+        row.neighbor_count_ = 0;
+        row.capacity_ = 0;
+    }
+
+    Edge num_edges_{0};
+    Edge num_free_{0};
+};
+
+}  // namespace naex
+
+#endif  // NAEX_NEIGHBOR_GRAPH_H
@@ -6,6 +6,7 @@
 #define NAEX_PLANNER_H
 
 #include <algorithm>
+#include <boost/function.hpp>
 #include <boost/graph/graph_concepts.hpp>
 #include <cmath>
 #include <cstddef>
@@ -16,8 +17,11 @@
 #include <map>
 #include <mutex>
 #include <naex/array.h>
+#include <naex/astar.h>
+#include <naex/bounded_queue.h>
 #include <naex/buffer.h>
 #include <naex/clouds.h>
+#include <naex/delta_stepping.h>
 #include <naex/exceptions.h>
 #include <naex/exclude_frames_filter.h>
 #include <naex/flann.h>
@@ -26,6 +30,8 @@
 #include <naex/nearest_neighbors.h>
 #include <naex/range_filter.h>
 #include <naex/reward.h>
+#include <naex/search_workspace.h>
+#include <naex/shortest_paths.h>
 #include <naex/step_filter.h>
 #include <naex/timer.h>
 #include <naex/transform_filter.h>
@@ -41,6 +47,7 @@
 #include <tf2_eigen/tf2_eigen.h>
 #include <tf2_ros/buffer.h>
 #include <tf2_ros/transform_listener.h>
+#include <thread>
 #include <unordered_map>
 
 namespace naex
@@ -56,6 +63,24 @@ namespace naex
 
 class Planner
 {
+protected:
+    /** Input cloud filtered in sensor frame, filtered in map frame, and its transform. */
+    struct InputCloud
+    {
+        sensor_msgs::PointCloud2 organized;
+        sensor_msgs::PointCloud2 filtered;
+        geometry_msgs::TransformStamped cloud_to_map;
+    };
+
+    /** Map changes from processed input clouds, to be published. */
+    struct MapUpdate
+    {
+        ros::Time stamp;
+        Vec3 origin;
+        sensor_msgs::PointCloud2 dirty;
+        sensor_msgs::PointCloud2 updated;
+    };
+
 public:
     Planner(ros::NodeHandle& nh, ros::NodeHandle& pnh):
         nh_(nh),
@@ -82,6 +107,11 @@ public:
                  time_initialized_, t.seconds_elapsed());
     }
 
+    ~Planner()
+    {
+        stop_input_pipeline();
+    }
+
     void update_params(const ros::WallTimerEvent& evt)
     {
         Timer t;
@@ -114,8 +144,12 @@ public:
         pnh_.param("max_pitch", map_.max_pitch_, map_.max_pitch_);
         pnh_.param("max_roll", map_.max_roll_, map_.max_roll_);
         pnh_.param("inclination_penalty", map_.inclination_penalty_, map_.inclination_penalty_);
+        pnh_.param("lazy_edge_costs", map_.lazy_edge_costs_, map_.lazy_edge_costs_);
 
         pnh_.param("neighborhood_radius", map_.neighborhood_radius_, map_.neighborhood_radius_);
+        pnh_.param("index_voxel_size", map_.index_voxel_size_, map_.index_voxel_size_);
+        pnh_.param("coarse_voxel_size", map_.coarse_voxel_size_, map_.coarse_voxel_size_);
+        pnh_.param("corridor_hops", corridor_hops_, corridor_hops_);
         pnh_.param("normal_radius", normal_radius_, normal_radius_);
 
         update_params(ros::WallTimerEvent());
@@ -131,6 +165,10 @@ public:
         pnh_.param("suppress_base_reward", suppress_base_reward_, suppress_base_reward_);
         pnh_.param("path_cost_pow", path_cost_pow_, path_cost_pow_);
         pnh_.param("min_path_cost", min_path_cost_, min_path_cost_);
+        pnh_.param("early_goal_selection", early_goal_selection_, early_goal_selection_);
+        pnh_.param("max_path_cost", max_path_cost_, max_path_cost_);
+        pnh_.param("max_expanded_vertices", max_expanded_vertices_, max_expanded_vertices_);
+        pnh_.param("delta_stepping", delta_stepping_, delta_stepping_);
         pnh_.param("planning_freq", planning_freq_, planning_freq_);
         pnh_.param("random_start", random_start_, random_start_);
         pnh_.param("plan_from_goal_dist", plan_from_goal_dist_, plan_from_goal_dist_);
@@ -139,12 +177,26 @@ public:
         int num_input_clouds = 1;
         pnh_.param("num_input_clouds", num_input_clouds, num_input_clouds);
         pnh_.param("input_queue_size", queue_size_, queue_size_);
+        pnh_.param("input_batch_window", input_batch_window_, input_batch_window_);
+        pnh_.param("async_input", async_input_, async_input_);
+        pnh_.param("pipeline_queue_size", pipeline_queue_size_, pipeline_queue_size_);
         pnh_.param("points_min_dist", map_.points_min_dist_, map_.points_min_dist_);
 
         pnh_.param("min_empty_cos", map_.min_empty_cos_, map_.min_empty_cos_);
         pnh_.param("min_num_empty", map_.min_num_empty_, map_.min_num_empty_);
         pnh_.param("min_empty_ratio", map_.min_empty_ratio_, map_.min_empty_ratio_);
         pnh_.param("max_occ_counter", map_.max_occ_counter_, map_.max_occ_counter_);
+#ifdef NAEX_COMPACT
+        if (map_.max_occ_counter_ > CompactPoint::MAX_OCC_COUNTER)
+        {
+            ROS_WARN("Max. occupancy counter %i limited to %i for compact points.",
+                     map_.max_occ_counter_, CompactPoint::MAX_OCC_COUNTER);
+            map_.max_occ_counter_ = CompactPoint::MAX_OCC_COUNTER;
+        }
+#endif
+        pnh_.param("range_image_occupancy", range_image_occupancy_, range_image_occupancy_);
+        pnh_.param("occupancy_depth_tolerance", map_.occupancy_depth_tolerance_, map_.occupancy_depth_tolerance_);
+        pnh_.param("occupancy_block_culling", map_.occupancy_block_culling_, map_.occupancy_block_culling_);
 
         pnh_.param("filter_robots", filter_robots_, filter_robots_);
 
@@ -175,11 +227,22 @@ public:
         path_pub_ = nh_.advertise<nav_msgs::Path>("path", 5);
 
         cloud_sub_ = nh_.subscribe("input_map", queue_size_, &Planner::cloud_received, this);
+        if (async_input_)
+        {
+            start_input_pipeline(size_t(num_input_clouds));
+        }
         for (int i = 0; i < num_input_clouds; ++i)
         {
             std::stringstream ss;
             ss << "input_cloud_" << i;
 //            auto sub = nh_.subscribe(ss.str(), queue_size_, &Planner::input_cloud_received, this);
+            if (async_input_)
+            {
+                boost::function<void(const sensor_msgs::PointCloud2::ConstPtr&)> cb
+                        = [this, i](const sensor_msgs::PointCloud2::ConstPtr& input) { input_cloud_queued(i, input); };
+                input_cloud_subs_.push_back(nh_.subscribe<sensor_msgs::PointCloud2>(ss.str(), queue_size_, cb));
+                continue;
+            }
             auto sub = nh_.subscribe(ss.str(), queue_size_, &Planner::input_cloud_received_safe, this);
             input_cloud_subs_.push_back(sub);
         }
@@ -321,35 +384,40 @@ public:
                     other_viewpoints_.push_back(pos);
                 }
 
-                if (map_.empty())
+                // Query index snapshot before locking the cloud for updates.
+                const auto index = map_.index();
+                if (!index)
                 {
                     ROS_WARN("Empty map, no points updated from gathered viewpoints.");
                     continue;
                 }
+                const Value radius = collect_rewards_ ? 2 * max_vp_distance_ : max_vp_distance_;
+                RadiusQuery<Value> q(*index, FMat(pos.data(), 1, 3), radius);
                 Lock cloud_lock(map_.cloud_mutex_);
-                Lock index_lock(map_.index_mutex_);
+                // Map may have been replaced meanwhile.
+                if (map_.index() != index)
+                {
+                    q = RadiusQuery<Value>(*map_.index(), FMat(pos.data(), 1, 3), radius);
+                }
+                assert(q.nn_.size() == 1);
+                assert(q.dist_.size() == 1);
 
                 if (collect_rewards_)
                 {
-                    RadiusQuery<Value> q1(*map_.index_, FMat(pos.data(), 1, 3), 2 * max_vp_distance_);
-
                     std::vector<Vec3> vps = {pos};
-                    update_coverage(map_.cloud_, q1.nn_[0], vps,
+                    update_coverage(map_.cloud_, q.nn_[0], vps,
                                     full_coverage_dist_, coverage_dist_spread_, max_vp_distance_,
                                     true, self);
 
-                    collect_rewards(map_.cloud_, q1.nn_[0],
+                    collect_rewards(map_.cloud_, q.nn_[0],
                                     full_coverage_dist_, coverage_dist_spread_, max_vp_distance_,
                                     self_factor_, suppress_base_reward_);
+                    reward_bound_.update(map_.cloud_, q.nn_[0]);
                 }
                 else
                 {
-                    RadiusQuery<Value> q(*map_.index_, FMat(pos.data(), 1, 3), max_vp_distance_);
-                    assert(q.nn_.size() == 1);
-                    assert(q.dist_.size() == 1);
-
                     ROS_DEBUG("%lu / %lu points within %.1f m from %s origin.",
-                              q.nn_[0].size(), map_.index_->size(), max_vp_distance_, frame.c_str());
+                              q.nn_[0].size(), index->size(), max_vp_distance_, frame.c_str());
                     for (Index i = 0; i < q.nn_[0].size(); ++i)
                     {
                         const Vertex v = q.nn_[0][i];
@@ -359,18 +427,19 @@ public:
                         if (self)
                         {
                             map_.cloud_[v].dist_to_actor_ = (std::isfinite(map_.cloud_[v].actor_last_visit_)
-                                                             ? std::min(map_.cloud_[v].dist_to_actor_, d)
+                                                             ? std::min<Value>(map_.cloud_[v].dist_to_actor_, d)
                                                              : d);
                             map_.cloud_[v].actor_last_visit_ = t;
                         }
                         else
                         {
                             map_.cloud_[v].dist_to_other_actors_ = (std::isfinite(map_.cloud_[v].other_actors_last_visit_)
-                                                                    ? std::min(map_.cloud_[v].dist_to_other_actors_, d)
+                                                                    ? std::min<Value>(map_.cloud_[v].dist_to_other_actors_, d)
                                                                     : d);
                             map_.cloud_[v].other_actors_last_visit_ = t;
                         }
                     }
+                    update_distance_rewards(q.nn_[0]);
                 }
             }
             catch (const tf2::TransformException& ex)
@@ -403,22 +472,100 @@ public:
                  robot_frames_.size(), t.seconds_elapsed());
     }
 
-    void trace_path_indices(Vertex start, Vertex goal, const Vertex* predecessor,
+    /**
+     * Closest vertex to position which can be reached from start, i.e.,
+     * the start itself or a traversable vertex away from edges.
+     */
+    Vertex nearest_reachable_candidate(const Vec3& position, Vertex v_start)
+    {
+        // Try nearest points first, scan the whole map if none qualifies.
+        Vec3 query = position;
+        Query<Value> q(*map_.index(), flann::Matrix<Value>(query.data(), 1, 3), Neighborhood::K_NEIGHBORS);
+        for (size_t j = 0; j < q.nn_.cols; ++j)
+        {
+            const Vertex v = q.nn_[0][j];
+            if (!valid_neighbor(v, q.dist_[0][j]))
+            {
+                break;
+            }
+            if (v == v_start)
+            {
+                return v_start;
+            }
+            if ((map_.cloud_[v].flags_ & TRAVERSABLE) && !(map_.cloud_[v].flags_ & EDGE))
+            {
+                return v;
+            }
+        }
+        Vertex v_nearest = v_start;
+        Value best_dist = (ConstVec3Map(map_.cloud_[v_start].position_) - position).squaredNorm();
+        for (Vertex v = 0; v < map_.num_vertices(); ++v)
+        {
+            if (!(map_.cloud_[v].flags_ & TRAVERSABLE) || (map_.cloud_[v].flags_ & EDGE))
+            {
+                continue;
+            }
+            const Value dist = (ConstVec3Map(map_.cloud_[v].position_) - position).squaredNorm();
+            if (dist < best_dist)
+            {
+                v_nearest = v;
+                best_dist = dist;
+            }
+        }
+        return v_nearest;
+    }
+
+    /**
+     * Plan on the coarse graph first and refine the path with A* restricted
+     * to a corridor of coarse nodes around it.
+     * @return Goal if reached, otherwise the closest vertex or invalid vertex.
+     */
+    Vertex search_in_corridor(Vertex v_start, Vertex v_target, const Vec3& goal_position)
+    {
+        Timer t;
+        const auto& coarse = map_.coarse_graph_;
+        // Start may lie off traversable points, use the node of a neighbor then.
+        auto start_node = coarse.node_of(v_start);
+        const auto edges = map_.out_edges(v_start);
+        for (Edge e = *edges.first; e != *edges.second && start_node == CoarseGraph::INVALID_NODE; ++e)
+        {
+            start_node = coarse.node_of(map_.target(e));
+        }
+        std::vector<CoarseGraph::Node> path;
+        if (!coarse.search(start_node, coarse.node_of(v_target), path))
+        {
+            ROS_INFO("No coarse path from node %i to %i (%.3f s).",
+                     start_node, coarse.node_of(v_target), t.seconds_elapsed());
+            return INVALID_VERTEX;
+        }
+        const auto corridor = coarse.corridor(path, corridor_hops_);
+        const auto v_goal = astar_.search(map_, v_start, v_target, goal_position, [&](Vertex v)
+        {
+            const auto i = coarse.node_of(v);
+            return i != CoarseGraph::INVALID_NODE && corridor[i];
+        });
+        ROS_INFO("Coarse path with %lu / %lu nodes refined in corridor (%lu expanded, %s): %.3f s.",
+                 path.size(), coarse.num_nodes(), astar_.num_expanded(),
+                 v_goal == v_target ? "reached" : "not reached", t.seconds_elapsed());
+        return v_goal;
+    }
+
+    void trace_path_indices(Vertex start, Vertex goal, const SearchWorkspace& paths,
                             std::vector<Vertex>& path_indices)
     {
-        assert(predecessor[start] == start);
+        assert(paths.predecessor(start) == start);
         Vertex v = goal;
         while (v != start)
         {
             path_indices.push_back(v);
-            v = predecessor[v];
+            v = paths.predecessor(v);
         }
         path_indices.push_back(v);
         std::reverse(path_indices.begin(), path_indices.end());
     }
 
     void append_path(const std::vector<Vertex>& path_indices,
-                     const std::vector<Point>& points,
+                     const Map::Cloud& points,
                      nav_msgs::Path& path)
     {
         if (path_indices.empty())
@@ -440,7 +587,7 @@ public:
                        pose.pose.position.z - path.poses.back().pose.position.z);
                 x.normalize();
 //                    Vec3Map z(normals[v]);
-                Vec3 z = ConstVec3Map(points[v].normal_);
+                Vec3 z = points[v].normal();
                 // Fix z direction to be consistent with the previous pose.
                 // As we start from the current robot pose with correct z
                 // orientation, all following z directions get corrected.
@@ -553,12 +700,15 @@ public:
 //        flann::Matrix<Elem> normals(normals_buf.begin(), n_pts, 3);
 //        ROS_INFO("Copy of %lu points and normals: %.3f s.", n_pts, t.seconds_elapsed());
         Lock cloud_lock(map_.cloud_mutex_);
-        Lock index_lock(map_.index_mutex_);
         Lock dirty_lock(map_.dirty_mutex_);
 
         map_.cloud_.clear();
         map_.graph_.clear();
         map_.clear_dirty();
+        map_.take_cost_updates();
+        shortest_paths_.reset();
+        reward_bound_.clear();
+        path_cost_vertices_.clear();
 
         auto points = flann_matrix_view<Value>(const_cast<sensor_msgs::PointCloud2&>(cloud), position_name_, uint32_t(3));
 //        auto points = const_flann_matrix_view<Value>(cloud, position_name_, uint32_t(3));
@@ -587,6 +737,27 @@ public:
         return r;
     }
 
+    /**
+     * Update rewards of points from distances to actors, used unless rewards
+     * are collected. Rewards change only with the distances and features,
+     * so points are updated when these are.
+     */
+    void update_distance_rewards(const std::vector<Vertex>& indices)
+    {
+        for (const auto v: indices)
+        {
+            const Value reward = std::max(std::min(distance_reward(map_.cloud_[v].dist_to_actor_),
+                                                   distance_reward(map_.cloud_[v].other_actors_last_visit_)),
+                                          self_factor_ * distance_reward(map_.cloud_[v].dist_to_actor_));
+            map_.cloud_[v].reward_ = reward * (1 + map_.cloud_[v].num_edge_neighbors_);
+            // Decrease rewards in specific areas (staging area).
+            // TODO: Ensure correct frame (subt) is used here.
+            // TODO: Parametrize the areas.
+            suppress_reward(map_.cloud_[v]);
+        }
+        reward_bound_.update(map_.cloud_, indices);
+    }
+
     bool plan(nav_msgs::GetPlanRequest& req, nav_msgs::GetPlanResponse& res)
     {
         Timer t;
@@ -644,8 +815,22 @@ public:
             }
         }
 
+        // Query start candidates in index snapshot before locking the cloud.
+        // The search itself still holds the cloud lock, it reads the live
+        // graph and writes path costs and rewards of map points, so map
+        // updates wait for it.
+        Vec3 start_position(Value(start.pose.position.x),
+                            Value(start.pose.position.y),
+                            Value(start.pose.position.z));
+        Value start_tol = req.tolerance > 0. ? req.tolerance : neighborhood_radius_;
+        auto index = map_.index();
+        std::vector<Vertex> candidates;
+        if (index)
+        {
+            candidates = map_.nearby_indices(start_position.data(), start_tol);
+        }
+
         Lock cloud_lock(map_.cloud_mutex_);
-        Lock index_lock(map_.index_mutex_);
 
         t.reset();
 
@@ -660,34 +845,21 @@ public:
         // TODO: Deal with occupancy on merging.
         // TODO: Index rebuild incrementally with new points.
 
-        // Create debug cloud for visualization of intermediate results.
-        sensor_msgs::PointCloud2 debug_cloud;
-//        map_.create_debug_cloud(debug_cloud);
-        map_.create_cloud_msg(debug_cloud);
-        debug_cloud.header.frame_id = map_frame_;
-        // TODO: Refresh on sending?
-        debug_cloud.header.stamp = ros::Time::now();
-        // Reconstruct original 2D shape.
-        debug_cloud.height = 1;
-        debug_cloud.width = uint32_t(map_.size());
-
         // Use the nearest traversable point to robot as the starting point.
-        Vec3 start_position(Value(start.pose.position.x),
-                            Value(start.pose.position.y),
-                            Value(start.pose.position.z));
-        Value start_tol = req.tolerance > 0. ? req.tolerance : neighborhood_radius_;
+        // Map may have been replaced meanwhile.
+        if (map_.index() != index)
+        {
+            candidates = map_.nearby_indices(start_position.data(), start_tol);
+        }
         std::vector<Vertex> traversable;
+        for (const auto v: candidates)
         {
-            Lock lock(map_.cloud_mutex_);
-            for (const auto v: map_.nearby_indices(start_position.data(), start_tol))
+            if (!(map_.cloud_[v].flags_ & TRAVERSABLE)
+                    || (map_.cloud_[v].flags_ & EDGE))
             {
-                if (!(map_.cloud_[v].flags_ & TRAVERSABLE)
-                        || (map_.cloud_[v].flags_ & EDGE))
-                {
-                    continue;
-                }
-                traversable.push_back(v);
+                continue;
             }
+            traversable.push_back(v);
         }
         if (traversable.empty())
         {
@@ -713,50 +885,36 @@ public:
         // TODO: Append starting pose as a special vertex with orientation dependent edges.
         // Note, that for some worlds and robots, the neighborhood must be quite large to get traversable points.
         // See e.g. X1 @ cave_circuit_practice_01.
-        Graph g(map_);
-        // Plan in NN graph with approx. travel time costs.
-        std::vector<Vertex> predecessor(size_t(g.num_vertices()),
-                                        INVALID_VERTEX);
-        std::vector<Value> path_costs(size_t(g.num_vertices()),
-                                      std::numeric_limits<Value>::infinity());
-        EdgeCosts edge_costs(map_);
-        boost::typed_identity_property_map<Vertex> index_map;
-
-        t_part.reset();
-        // TODO: Stop via exception if needed.
-        boost::dijkstra_shortest_paths_no_color_map(g, v_start,
-                                                    predecessor.data(), path_costs.data(), edge_costs,
-                                                    index_map,
-                                                    std::less<Value>(), boost::closed_plus<Value>(),
-                                                    std::numeric_limits<Value>::infinity(), Value(0.),
-                                                    boost::dijkstra_visitor<boost::null_visitor>());
-        ROS_INFO("Dijkstra (%u pts): %.3f s.",
-                 g.num_vertices(), t_part.seconds_elapsed());
-
         // If planning for a given goal, return path to the closest reachable
         // point from the goal.
-        t_part.reset();
         if (valid_point(req.goal.pose.position.x,
                         req.goal.pose.position.y,
                         req.goal.pose.position.z))
         {
-            Vec3 goal_position(Value(req.goal.pose.position.x),
-                               Value(req.goal.pose.position.y),
-                               Value(req.goal.pose.position.z));
+            t_part.reset();
+            const Vec3 goal_position(Value(req.goal.pose.position.x),
+                                     Value(req.goal.pose.position.y),
+                                     Value(req.goal.pose.position.z));
+            const Vertex v_target = nearest_reachable_candidate(goal_position, v_start);
             Vertex v_goal = INVALID_VERTEX;
-            Value best_dist = std::numeric_limits<Value>::infinity();
-            for (Index v = 0; v < path_costs.size(); ++v)
+            // Trace the path in the previous shortest-path tree if still valid.
+            if (shortest_paths_.reusable(v_start, map_.pending_cost_updates())
+                    && shortest_paths_.settled(v_target))
             {
-                if (!std::isfinite(path_costs[v]))
+                v_goal = v_target;
+                ROS_INFO("Path traced in previous shortest paths: %.3f s.", t_part.seconds_elapsed());
+            }
+            else
+            {
+                if (map_.coarse_voxel_size_ > 0)
                 {
-                    continue;
+                    v_goal = search_in_corridor(v_start, v_target, goal_position);
                 }
-                Value dist = (ConstVec3Map(map_.cloud_[v].position_) - goal_position).norm();
-                if (dist < best_dist)
+                if (v_goal != v_target)
                 {
-                    v_goal = v;
-                    best_dist = dist;
+                    v_goal = astar_.search(map_, v_start, v_target, goal_position);
                 }
+                ROS_INFO("A* (%lu expanded): %.3f s.", astar_.num_expanded(), t_part.seconds_elapsed());
             }
             if (v_goal == INVALID_VERTEX)
             {
@@ -766,7 +924,7 @@ public:
                 return false;
             }
             std::vector<Vertex> path_indices;
-            trace_path_indices(v_start, v_goal, predecessor.data(), path_indices);
+            trace_path_indices(v_start, v_goal, search_workspace_, path_indices);
             res.plan.header.frame_id = map_frame_;
             res.plan.header.stamp = ros::Time::now();
             res.plan.poses.push_back(start);
@@ -779,40 +937,97 @@ public:
             return true;
         }
 
-        // TODO: Account for time to enable patrolling (coverage half-life).
-        Vertex v_goal = INVALID_VERTEX;
-        for (Vertex v = 0; v < path_costs.size(); ++v)
+        // Rewards are needed before the search to bound relative costs.
+        // Points with features recomputed since the last plan are those
+        // with updated edge costs.
+        t_part.reset();
+        const auto cost_updates = map_.take_cost_updates();
+        if (!collect_rewards_)
+        {
+            update_distance_rewards(cost_updates);
+        }
+        const Value max_reward = reward_bound_.max(map_.cloud_);
+        ROS_DEBUG("Max. reward %.3f (%.3f s).", max_reward, t_part.seconds_elapsed());
+
+        SearchLimits limits;
+        limits.max_cost = max_path_cost_;
+        limits.max_expanded = size_t(std::max(max_expanded_vertices_, 0));
+        // Path costs of vertices settled later are not lower, so their
+        // relative costs are bounded by the max. reward.
+        Value best_relative_cost = std::numeric_limits<Value>::infinity();
+        if (early_goal_selection_ && path_cost_pow_ > 0 && max_reward > 0)
         {
-            if (!collect_rewards_)
+            limits.stop = [&](Vertex v, Value cost)
             {
-                map_.cloud_[v].reward_ = std::max(std::min(distance_reward(map_.cloud_[v].dist_to_actor_),
-                                                           distance_reward(map_.cloud_[v].other_actors_last_visit_)),
-                                                  self_factor_ * distance_reward(map_.cloud_[v].dist_to_actor_));
-                map_.cloud_[v].reward_ *= (1 + map_.cloud_[v].num_edge_neighbors_);
-                // Decrease rewards in specific areas (staging area).
-                // TODO: Ensure correct frame (subt) is used here.
-                // TODO: Parametrize the areas.
-                suppress_reward(map_.cloud_[v]);
+                const Value cost_pow = std::pow(cost, path_cost_pow_);
+                if (cost >= min_path_cost_)
+                {
+                    best_relative_cost = std::min(best_relative_cost, cost_pow / map_.cloud_[v].reward_);
+                }
+                return best_relative_cost <= cost_pow / max_reward;
+            };
+        }
+
+        // Plan in NN graph with approx. travel time costs, either in parallel
+        // from scratch, or repairing previous paths if the start has not changed.
+        t_part.reset();
+        const bool parallel = delta_stepping_ > 0 && !limits.partial();
+        if (parallel)
+        {
+            shortest_paths_.reset();
+            const auto n_reached = delta_stepping_paths_.compute(map_, v_start, delta_stepping_, limits.max_cost);
+            ROS_INFO("Delta-stepping shortest paths (%u pts, %lu reached): %.3f s.",
+                     map_.num_vertices(), n_reached, t_part.seconds_elapsed());
+        }
+        else
+        {
+            const auto n_updated = shortest_paths_.update(map_, v_start, cost_updates, limits);
+            ROS_INFO("Shortest paths (%u pts, %lu with changed costs, %lu updated): %.3f s.",
+                     map_.num_vertices(), cost_updates.size(), n_updated, t_part.seconds_elapsed());
+        }
+        const auto& paths = search_workspace_;
+
+        // Points keep path costs only from the last plan, those settled
+        // previously but not now are reset.
+        for (const auto v: path_cost_vertices_)
+        {
+            if (v < map_.num_vertices())
+            {
+                map_.cloud_[v].path_cost_ = std::numeric_limits<Value>::infinity();
+                map_.cloud_[v].relative_cost_ = std::numeric_limits<Value>::infinity();
             }
+        }
 
+        // TODO: Account for time to enable patrolling (coverage half-life).
+        Vertex v_goal = INVALID_VERTEX;
+        Value goal_relative_cost = std::numeric_limits<Value>::quiet_NaN();
+        // Goal is selected from settled vertices only. Those left unsettled
+        // by early goal selection have relative costs not lower than the best
+        // one. Goal is selected from search path costs, points may store them
+        // with lower precision.
+        for (const auto v: paths.settled())
+        {
             // Keep original path cost, but discount for relative cost.
 //            map_.cloud_[v].path_cost_ = std::isfinite(path_costs[v])
 //                                        ? path_costs[v]
 //                                        : std::numeric_limits<Value>::quiet_NaN();
-            map_.cloud_[v].path_cost_ = path_costs[v];
-            map_.cloud_[v].relative_cost_ = std::pow(map_.cloud_[v].path_cost_, path_cost_pow_)
-                                            / map_.cloud_[v].reward_;
+            const Value path_cost = paths.path_cost(v);
+            const Value relative_cost = std::pow(path_cost, path_cost_pow_) / map_.cloud_[v].reward_;
+            map_.cloud_[v].path_cost_ = path_cost;
+            map_.cloud_[v].relative_cost_ = relative_cost;
             // Prefer longer feasible paths, with lowest relative costs.
-            if (std::isfinite(map_.cloud_[v].path_cost_)
-                && map_.cloud_[v].path_cost_ >= min_path_cost_
+            if (std::isfinite(path_cost)
+                && path_cost >= min_path_cost_
                 && (v_goal == INVALID_VERTEX
 //                    ||  (map_.cloud_[v_goal].path_cost_ < min_path_cost_
 //                         && map_.cloud_[v].path_cost_ >= min_path_cost_)
-                    || map_.cloud_[v].relative_cost_ < map_.cloud_[v_goal].relative_cost_))
+                    || relative_cost < goal_relative_cost))
             {
                 v_goal = v;
+                goal_relative_cost = relative_cost;
             }
         }
+        path_cost_vertices_ = paths.settled();
 
         if (map_pub_.getNumSubscribers() > 0)
         {
@@ -836,7 +1051,7 @@ public:
 
         Timer t_path;
         std::vector<Vertex> path_indices;
-        trace_path_indices(v_start, v_goal, predecessor.data(), path_indices);
+        trace_path_indices(v_start, v_goal, paths, path_indices);
         res.plan.header.frame_id = map_frame_;
         res.plan.header.stamp = ros::Time::now();
         res.plan.poses.push_back(start);
@@ -853,9 +1068,9 @@ public:
                  map_.cloud_[v_goal].position_[0],
                  map_.cloud_[v_goal].position_[1],
                  map_.cloud_[v_goal].position_[2],
-                 map_.cloud_[v_goal].path_cost_,
-                 map_.cloud_[v_goal].reward_,
-                 map_.cloud_[v_goal].relative_cost_,
+                 paths.path_cost(v_goal),
+                 Value(map_.cloud_[v_goal].reward_),
+                 goal_relative_cost,
                  t.seconds_elapsed());
         return true;
     }
@@ -1024,22 +1239,33 @@ public:
         send_cloud(map_pub_, stamp, force);
     }
 
+    /** Create cloud of selected points if there is anyone to receive it. */
     template<typename C>
-    void send_cloud(ros::Publisher& pub, const C& indices, const ros::Time& stamp = ros::Time(0), bool force = false)
+    bool create_cloud(ros::Publisher& pub, const C& indices, sensor_msgs::PointCloud2& cloud,
+                      const ros::Time& stamp = ros::Time(0), bool force = false)
     {
         if (indices.empty())
-            return;
+            return false;
         if (force || pub.getNumSubscribers() > 0)
         {
-            Timer t;
-            sensor_msgs::PointCloud2 cloud;
             cloud.header.frame_id = map_frame_;
             cloud.header.stamp = stamp.toNSec() == 0 ? ros::Time::now() : stamp;
 //            {
 //                Lock cloud_lock(map_.cloud_mutex_);
-//                Lock index_lock(map_.index_mutex_);
                 map_.create_cloud_msg(indices, cloud);
 //            }
+            return true;
+        }
+        return false;
+    }
+
+    template<typename C>
+    void send_cloud(ros::Publisher& pub, const C& indices, const ros::Time& stamp = ros::Time(0), bool force = false)
+    {
+        Timer t;
+        sensor_msgs::PointCloud2 cloud;
+        if (create_cloud(pub, indices, cloud, stamp, force))
+        {
             pub.publish(cloud);
             ROS_DEBUG("Sending cloud %s: %.3f s.", pub.getTopic().c_str(), t.seconds_elapsed());
         }
@@ -1050,10 +1276,9 @@ public:
         if (force || dirty_map_pub_.getNumSubscribers() > 0)
         {
             Lock cloud_lock(map_.cloud_mutex_);
-            Lock index_lock(map_.index_mutex_);
             Lock updated_lock(map_.updated_mutex_);
             Lock dirty_lock(map_.dirty_mutex_);
-            send_cloud(dirty_map_pub_, map_.dirty_indices_, stamp, force);
+            send_cloud(dirty_map_pub_, map_.dirty_indices_.indices(), stamp, force);
         }
     }
 
@@ -1062,7 +1287,6 @@ public:
         if (force || updated_map_pub_.getNumSubscribers() > 0)
         {
             Lock cloud_lock(map_.cloud_mutex_);
-            Lock index_lock(map_.index_mutex_);
             Lock updated_lock(map_.updated_mutex_);
             send_cloud(updated_map_pub_, map_.updated_indices_, stamp, force);
         }
@@ -1072,45 +1296,37 @@ public:
     {
         if (force || local_map_pub_.getNumSubscribers() > 0)
         {
+            Lock cloud_lock(map_.cloud_mutex_);
             const auto indices = map_.nearby_indices(origin, input_range_);
             send_cloud(local_map_pub_, indices, stamp, force);
         }
     }
 
-    void input_cloud_received(const sensor_msgs::PointCloud2::ConstPtr& input)
+    /**
+     * Filter input cloud and look up its transform to map,
+     * without locking the map.
+     * @return Whether the cloud is recent enough to be used.
+     */
+    bool prepare_input_cloud(const sensor_msgs::PointCloud2::ConstPtr& input, InputCloud& prepared)
     {
         const auto age = (ros::Time::now() - input->header.stamp).toSec();
         if (age > max_cloud_age_)
         {
             ROS_INFO("Skipping old input cloud from %s, age %.1f s > %.1f s.",
                      input->header.frame_id.c_str(), age, max_cloud_age_);
-            return;
+            return false;
         }
 
         check_initialized();
-        sensor_msgs::PointCloud2 step_filtered;
         StepFilter step_filter(1024, 1024);
-        step_filter.filter(*input, step_filtered);
+        step_filter.filter(*input, prepared.organized);
 
         Timer t_tf;
         double wait = std::max(5.0 - (ros::Time::now() - input->header.stamp).toSec(), 0.0);
-        geometry_msgs::TransformStamped cloud_to_map;
-        cloud_to_map = tf_->lookupTransform(map_frame_, input->header.frame_id, input->header.stamp,
-                                            ros::Duration(wait));
+        prepared.cloud_to_map = tf_->lookupTransform(map_frame_, input->header.frame_id, input->header.stamp,
+                                                     ros::Duration(wait));
         ROS_DEBUG("Had to wait %.3f s for input cloud transform.", t_tf.seconds_elapsed());
 
-        Eigen::Isometry3f transform(tf2::transformToEigen(cloud_to_map.transform));
-
-        // TODO: Update map occupancy based on reconstructed surface of 2D cloud.
-        if (step_filtered.height > 1 && step_filtered.width > 1)
-        {
-            map_.update_occupancy_projection(step_filtered, cloud_to_map.transform);
-        }
-        else
-        {
-            ROS_WARN("Cannot update occupancy using unstructured point cloud.");
-        }
-
         Timer t_filter;
         FilterChain<sensor_msgs::PointCloud2>::Filters filters{
             std::make_shared<VoxelFilter<float, int>>("x", map_.points_min_dist_),
@@ -1120,32 +1336,188 @@ public:
                 std::make_shared<TransformProcessor<float>>("x", map_frame_, tf_, ros::Duration(3.0)))
         };
         FilterChain<sensor_msgs::PointCloud2> chain(filters);
-
-        auto cloud = std::make_shared<sensor_msgs::PointCloud2>();
-        chain.filter(step_filtered, *cloud);
+        chain.filter(prepared.organized, prepared.filtered);
         ROS_INFO("%lu filters applied (%.3f s).", filters.size(), t_filter.seconds_elapsed());
+        return true;
+    }
+
+    void update_occupancy(const InputCloud& input)
+    {
+        // TODO: Update map occupancy based on reconstructed surface of 2D cloud.
+        const auto& cloud = input.organized;
+        if (cloud.height > 1 && cloud.width > 1 && range_image_occupancy_)
+        {
+            map_.update_occupancy_range_image(cloud, input.cloud_to_map.transform, input_range_);
+        }
+        else if (cloud.height > 1 && cloud.width > 1)
+        {
+            map_.update_occupancy_projection(cloud, input.cloud_to_map.transform);
+        }
+        else
+        {
+            ROS_WARN("Cannot update occupancy using unstructured point cloud.");
+        }
+    }
+
+    /**
+     * Update occupancy from all input clouds and merge their points at once,
+     * with a single index update, dirty update and publication.
+     */
+    void process_input_clouds(const std::vector<InputCloud>& inputs)
+    {
+        if (inputs.empty())
+        {
+            return;
+        }
+        MapUpdate update;
+        update_map(inputs, update);
+        publish_map_update(update);
+    }
 
-        Vec3 origin = transform.translation();
-        flann::Matrix<Elem> origin_mat(origin.data(), 1, 3);
+    /**
+     * Update occupancy from input clouds and merge their points,
+     * keeping dirty and updated points for publishing.
+     */
+    void update_map(const std::vector<InputCloud>& inputs, MapUpdate& update)
+    {
+        Timer t;
+        size_t n_points = 0;
+        ros::Time stamp = inputs.front().filtered.header.stamp;
+        for (const auto& input: inputs)
+        {
+            n_points += num_points(input.filtered);
+            stamp = std::max(stamp, input.filtered.header.stamp);
+        }
+        std::vector<Elem> points_buf;
+        points_buf.reserve(3 * n_points);
+        for (const auto& input: inputs)
+        {
+            const size_t n = num_points(input.filtered);
+            sensor_msgs::PointCloud2ConstIterator<float> x_it(input.filtered, "x");
+            for (size_t i = 0; i < n; ++i, ++x_it)
+            {
+                points_buf.insert(points_buf.end(), &x_it[0], &x_it[0] + 3);
+            }
+        }
+        flann::Matrix<Elem> points(points_buf.data(), n_points, 3);
 
-        const auto points = flann_matrix_view<float>(*cloud, "x", 3);
+        update.stamp = stamp;
+        update.origin = tf2::transformToEigen(inputs.back().cloud_to_map.transform).translation().cast<Elem>();
+        flann::Matrix<Elem> origin_mat(update.origin.data(), 1, 3);
+        // Search index snapshot before locking the cloud, overlapping with planning.
+        auto neighbors = map_.merge_neighbors(points);
 
         Lock cloud_lock(map_.cloud_mutex_);
-        Lock index_lock(map_.index_mutex_);
+        for (const auto& input: inputs)
+        {
+            update_occupancy(input);
+        }
         {
             Lock added_lock(map_.updated_mutex_);
             Lock lock_dirty(map_.dirty_mutex_);
-            map_.merge(points, origin_mat);
+            map_.merge(points, origin_mat, std::move(neighbors));
             map_.update_dirty();
-//            ROS_INFO("Input cloud with %u points merged: %.3f s.", n_added, t.seconds_elapsed());
             // TODO: Mark affected map points for update?
-            send_dirty_cloud(cloud->header.stamp);
+            create_cloud(dirty_map_pub_, map_.dirty_indices_.indices(), update.dirty, stamp);
             map_.clear_dirty();
-            send_updated_cloud(cloud->header.stamp);
+            create_cloud(updated_map_pub_, map_.updated_indices_, update.updated, stamp);
             map_.clear_updated();
         }
-        send_local_map(origin.data(), cloud->header.stamp);
-        send_map(cloud->header.stamp);
+        if (inputs.size() > 1)
+        {
+            ROS_INFO("Batch of %lu input clouds with %lu points processed (%.3f s).",
+                     inputs.size(), n_points, t.seconds_elapsed());
+        }
+    }
+
+    void publish_map_update(MapUpdate& update)
+    {
+        if (update.dirty.height * update.dirty.width > 0)
+        {
+            dirty_map_pub_.publish(update.dirty);
+        }
+        if (update.updated.height * update.updated.width > 0)
+        {
+            updated_map_pub_.publish(update.updated);
+        }
+        send_local_map(update.origin.data(), update.stamp);
+        send_map(update.stamp);
+    }
+
+    void input_cloud_received(const sensor_msgs::PointCloud2::ConstPtr& input)
+    {
+        InputCloud prepared;
+        if (!prepare_input_cloud(input, prepared))
+        {
+            return;
+        }
+        if (input_cloud_subs_.size() <= 1 || !(input_batch_window_ > 0.))
+        {
+            std::vector<InputCloud> inputs;
+            inputs.push_back(std::move(prepared));
+            process_input_clouds(inputs);
+            return;
+        }
+
+        // Collect clouds from all sensors arriving within the batch window.
+        // A batch is processed once it has a cloud from each sensor,
+        // a sensor sends another cloud, or the window elapses.
+        std::vector<std::vector<InputCloud>> ready;
+        {
+            std::lock_guard<std::mutex> lock(input_batch_mutex_);
+            const auto& frame = prepared.organized.header.frame_id;
+            const bool repeated = std::any_of(input_batch_.begin(), input_batch_.end(),
+                                              [&frame](const InputCloud& c)
+                                              { return c.organized.header.frame_id == frame; });
+            if (repeated)
+            {
+                ready.push_back(std::move(input_batch_));
+                input_batch_.clear();
+                ++input_batch_id_;
+            }
+            input_batch_.push_back(std::move(prepared));
+            if (input_batch_.size() >= input_cloud_subs_.size())
+            {
+                ready.push_back(std::move(input_batch_));
+                input_batch_.clear();
+                ++input_batch_id_;
+            }
+            else if (input_batch_.size() == 1)
+            {
+                const auto id = input_batch_id_;
+                input_batch_timer_ = nh_.createTimer(ros::Duration(input_batch_window_),
+                                                     [this, id](const ros::TimerEvent&) { input_batch_timeout(id); },
+                                                     true);
+            }
+        }
+        for (const auto& batch: ready)
+        {
+            process_input_clouds(batch);
+        }
+    }
+
+    /** Process incomplete batch of input clouds once its window elapsed. */
+    void input_batch_timeout(size_t id)
+    {
+        std::vector<InputCloud> ready;
+        {
+            std::lock_guard<std::mutex> lock(input_batch_mutex_);
+            if (id != input_batch_id_)
+            {
+                return;
+            }
+            ready.swap(input_batch_);
+            ++input_batch_id_;
+        }
+        ROS_DEBUG("Batch window elapsed with %lu of %lu input clouds.", ready.size(), input_cloud_subs_.size());
+        try
+        {
+            process_input_clouds(ready);
+        }
+        catch (...)
+        {
+            log_input_error(std::current_exception());
+        }
     }
 
     void input_cloud_received_safe(const sensor_msgs::PointCloud2::ConstPtr& input)
@@ -1154,11 +1526,22 @@ public:
         {
             input_cloud_received(input);
         }
+        catch (...)
+        {
+            log_input_error(std::current_exception(), input->header.frame_id);
+        }
+    }
+
+    void log_input_error(const std::exception_ptr& error, const std::string& frame = "")
+    {
+        try
+        {
+            std::rethrow_exception(error);
+        }
         catch (const tf2::TransformException& ex)
         {
             ROS_ERROR("Could not transform input cloud from %s to %s: %s.",
-                      input->header.frame_id.c_str(), map_frame_.c_str(), ex.what());
-            return;
+                      frame.c_str(), map_frame_.c_str(), ex.what());
         }
         catch (const Exception& ex)
         {
@@ -1175,6 +1558,150 @@ public:
         }
     }
 
+    /**
+     * Start asynchronous input pipeline. Each sensor has its own
+     * preprocessing thread, so that waiting for transforms of one sensor
+     * blocks neither the others nor map updates. Map updates and publishing
+     * have a thread each, so that filtering of next clouds overlaps with
+     * updating the map from previous ones. Stages are connected by bounded
+     * queues which drop the oldest items once full.
+     */
+    void start_input_pipeline(size_t num_inputs)
+    {
+        const auto capacity = size_t(std::max(pipeline_queue_size_, 1));
+        prepared_queue_.reset(new BoundedQueue<InputCloud>(capacity * num_inputs));
+        publish_queue_.reset(new BoundedQueue<MapUpdate>(capacity));
+        for (size_t i = 0; i < num_inputs; ++i)
+        {
+            input_queues_.emplace_back(new BoundedQueue<sensor_msgs::PointCloud2::ConstPtr>(capacity));
+            pipeline_threads_.emplace_back(&Planner::preprocess_input_clouds, this, i);
+        }
+        pipeline_threads_.emplace_back(&Planner::update_map_from_input_clouds, this);
+        pipeline_threads_.emplace_back(&Planner::publish_map_updates, this);
+        ROS_INFO("Input pipeline started for %lu inputs with queues of %lu items.", num_inputs, capacity);
+    }
+
+    void stop_input_pipeline()
+    {
+        for (auto& queue: input_queues_)
+        {
+            queue->close();
+        }
+        if (prepared_queue_)
+        {
+            prepared_queue_->close();
+        }
+        if (publish_queue_)
+        {
+            publish_queue_->close();
+        }
+        for (auto& thread: pipeline_threads_)
+        {
+            thread.join();
+        }
+        pipeline_threads_.clear();
+    }
+
+    void input_cloud_queued(size_t i, const sensor_msgs::PointCloud2::ConstPtr& input)
+    {
+        if (input_queues_[i]->push(input))
+        {
+            ROS_WARN_THROTTLE(1.0, "Oldest input cloud from %s dropped, preprocessing lags behind.",
+                              input->header.frame_id.c_str());
+        }
+    }
+
+    /** Preprocessing stage of input pipeline for a single sensor. */
+    void preprocess_input_clouds(size_t i)
+    {
+        sensor_msgs::PointCloud2::ConstPtr input;
+        while (input_queues_[i]->pop(input))
+        {
+            try
+            {
+                InputCloud prepared;
+                if (!prepare_input_cloud(input, prepared))
+                {
+                    continue;
+                }
+                if (prepared_queue_->push(std::move(prepared)))
+                {
+                    ROS_WARN_THROTTLE(1.0, "Oldest filtered input cloud dropped, map update lags behind.");
+                }
+            }
+            catch (...)
+            {
+                log_input_error(std::current_exception(), input->header.frame_id);
+            }
+        }
+    }
+
+    /**
+     * Map update stage of input pipeline, collecting clouds from all sensors
+     * within the batch window as in input_cloud_received.
+     */
+    void update_map_from_input_clouds()
+    {
+        const bool batch = input_queues_.size() > 1 && input_batch_window_ > 0.;
+        const auto window = std::chrono::duration_cast<BoundedQueue<InputCloud>::Clock::duration>(
+                std::chrono::duration<double>(input_batch_window_));
+        InputCloud next;
+        bool has_next = false;
+        while (true)
+        {
+            std::vector<InputCloud> inputs;
+            if (!has_next && !prepared_queue_->pop(next))
+            {
+                return;
+            }
+            inputs.push_back(std::move(next));
+            has_next = false;
+            const auto deadline = BoundedQueue<InputCloud>::Clock::now() + window;
+            while (batch && inputs.size() < input_queues_.size() && prepared_queue_->pop_until(next, deadline))
+            {
+                const auto& frame = next.organized.header.frame_id;
+                if (std::any_of(inputs.begin(), inputs.end(),
+                                [&frame](const InputCloud& c) { return c.organized.header.frame_id == frame; }))
+                {
+                    // Sensor sent another cloud, leave it for the next batch.
+                    has_next = true;
+                    break;
+                }
+                inputs.push_back(std::move(next));
+            }
+            try
+            {
+                MapUpdate update;
+                update_map(inputs, update);
+                if (publish_queue_->push(std::move(update)))
+                {
+                    ROS_WARN_THROTTLE(1.0, "Oldest map update dropped, publishing lags behind.");
+                }
+            }
+            catch (...)
+            {
+                log_input_error(std::current_exception());
+            }
+        }
+    }
+
+    /** Publishing stage of input pipeline. */
+    void publish_map_updates()
+    {
+        MapUpdate update;
+        while (publish_queue_->pop(update))
+        {
+            try
+            {
+                publish_map_update(update);
+            }
+            catch (...)
+            {
+                log_input_error(std::current_exception());
+            }
+        }
+    }
+
 protected:
     typedef std::recursive_mutex Mutex;
     typedef std::lock_guard<Mutex> Lock;
@@ -1191,6 +1718,19 @@ protected:
     ros::Subscriber cloud_sub_;
 
     std::vector<ros::Subscriber> input_cloud_subs_;
+    // Window for batching clouds from multiple sensors, zero to process each separately.
+    double input_batch_window_{0.05};
+    std::mutex input_batch_mutex_;
+    std::vector<InputCloud> input_batch_;
+    size_t input_batch_id_{0};
+    ros::Timer input_batch_timer_;
+    // Process input clouds in a pipeline of worker threads instead of callbacks.
+    bool async_input_{true};
+    int pipeline_queue_size_{2};
+    std::vector<std::unique_ptr<BoundedQueue<sensor_msgs::PointCloud2::ConstPtr>>> input_queues_{};
+    std::unique_ptr<BoundedQueue<InputCloud>> prepared_queue_{};
+    std::unique_ptr<BoundedQueue<MapUpdate>> publish_queue_{};
+    std::vector<std::thread> pipeline_threads_{};
     ros::Publisher map_pub_;
     ros::Publisher updated_map_pub_;
     ros::Publisher dirty_map_pub_;
@@ -1213,6 +1753,8 @@ protected:
     float max_cloud_age_{5.0};
     float input_range_{10.0};
     bool filter_robots_{false};
+    // Update occupancy by depth lookups in range image instead of projection.
+    bool range_image_occupancy_{false};
 
     int neighborhood_knn_{12};
     float neighborhood_radius_{0.5};
@@ -1235,6 +1777,17 @@ protected:
     bool suppress_base_reward_{true};
     float path_cost_pow_{1.0};
     float min_path_cost_{0.0};
+    // Stop shortest-path search once no unsettled vertex can be a better goal.
+    bool early_goal_selection_{false};
+    // Planning horizon, vertices with higher path costs are not reached.
+    float max_path_cost_{std::numeric_limits<float>::infinity()};
+    // Maximum number of vertices expanded in planning, zero for no limit.
+    int max_expanded_vertices_{0};
+    // Coarse graph hops around coarse path allowed for refined path.
+    int corridor_hops_{1};
+    // Bucket width of parallel delta-stepping search, around typical edge cost,
+    // zero for sequential incremental search.
+    float delta_stepping_{0.0};
     // Re-planning frequency, repeating the last request if positive.
     float planning_freq_{0.5};
     // Randomize starting vertex within tolerance radius.
@@ -1251,6 +1804,16 @@ protected:
     int queue_size_{5};
     Mutex map_mutex_;
     Map map_{};
+    // Guarded by map cloud mutex.
+    // Paths of the last search, shared by all searches below.
+    SearchWorkspace search_workspace_{};
+    IncrementalShortestPaths shortest_paths_{search_workspace_};
+    DeltaStepping delta_stepping_paths_{search_workspace_};
+    AStar astar_{search_workspace_};
+    // Max. reward of points.
+    RewardBound reward_bound_{};
+    // Points with path costs set by the last plan.
+    std::vector<Vertex> path_cost_vertices_{};
 };
 
 }  // namespace naex
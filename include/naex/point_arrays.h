@@ -0,0 +1,329 @@
+#ifndef NAEX_POINT_ARRAYS_H
+#define NAEX_POINT_ARRAYS_H
+
+#include <algorithm>
+#include <naex/types.h>
+#include <type_traits>
+#include <vector>
+
+namespace naex
+{
+
+/**
+ * Reference to a point stored in PointArrays.
+ *
+ * Members mirror those of Point, array members being pointers and scalar
+ * members being references, so that code written for Point, e.g.,
+ * cloud[i].flags_ & STATIC or ConstVec3Map(cloud[i].position_),
+ * works with both storage layouts.
+ *
+ * @tparam Const Whether the referenced point is read-only.
+ */
+template<bool Const>
+class PointRefT
+{
+public:
+    typedef typename std::conditional<Const, const Value, Value>::type V;
+    typedef typename std::conditional<Const, const uint8_t, uint8_t>::type U8;
+
+    template<typename A>
+    PointRefT(A& arrays, size_t i):
+        position_(&arrays.position_[3 * i]),
+        normal_(&arrays.normal_[3 * i]),
+        normal_support_(arrays.normal_support_[i]),
+        ground_diff_std_(arrays.ground_diff_std_[i]),
+        min_ground_diff_(arrays.min_ground_diff_[i]),
+        max_ground_diff_(arrays.max_ground_diff_[i]),
+        mean_abs_ground_diff_(arrays.mean_abs_ground_diff_[i]),
+        viewpoint_(&arrays.viewpoint_[3 * i]),
+        dist_to_actor_(arrays.dist_to_actor_[i]),
+        actor_last_visit_(arrays.actor_last_visit_[i]),
+        dist_to_other_actors_(arrays.dist_to_other_actors_[i]),
+        other_actors_last_visit_(arrays.other_actors_last_visit_[i]),
+        coverage_(arrays.coverage_[i]),
+        self_coverage_(arrays.self_coverage_[i]),
+        dist_to_obstacle_(arrays.dist_to_obstacle_[i]),
+        flags_(arrays.flags_[i]),
+        num_empty_(arrays.num_empty_[i]),
+        num_occupied_(arrays.num_occupied_[i]),
+        dist_to_plane_(arrays.dist_to_plane_[i]),
+        num_obstacle_pts_(arrays.num_obstacle_pts_[i]),
+        num_obstacle_neighbors_(arrays.num_obstacle_neighbors_[i]),
+        num_edge_neighbors_(arrays.num_edge_neighbors_[i]),
+        path_cost_(arrays.path_cost_[i]),
+        reward_(arrays.reward_[i]),
+        relative_cost_(arrays.relative_cost_[i])
+    {}
+
+    /** Gather referenced values into a standalone point. */
+    operator Point() const
+    {
+        Point p;
+        std::copy(position_, position_ + 3, p.position_);
+        std::copy(normal_, normal_ + 3, p.normal_);
+        p.normal_support_ = normal_support_;
+        p.ground_diff_std_ = ground_diff_std_;
+        p.min_ground_diff_ = min_ground_diff_;
+        p.max_ground_diff_ = max_ground_diff_;
+        p.mean_abs_ground_diff_ = mean_abs_ground_diff_;
+        std::copy(viewpoint_, viewpoint_ + 3, p.viewpoint_);
+        p.dist_to_actor_ = dist_to_actor_;
+        p.actor_last_visit_ = actor_last_visit_;
+        p.dist_to_other_actors_ = dist_to_other_actors_;
+        p.other_actors_last_visit_ = other_actors_last_visit_;
+        p.coverage_ = coverage_;
+        p.self_coverage_ = self_coverage_;
+        p.dist_to_obstacle_ = dist_to_obstacle_;
+        p.flags_ = flags_;
+        p.num_empty_ = num_empty_;
+        p.num_occupied_ = num_occupied_;
+        p.dist_to_plane_ = dist_to_plane_;
+        p.num_obstacle_pts_ = num_obstacle_pts_;
+        p.num_obstacle_neighbors_ = num_obstacle_neighbors_;
+        p.num_edge_neighbors_ = num_edge_neighbors_;
+        p.path_cost_ = path_cost_;
+        p.reward_ = reward_;
+        p.relative_cost_ = relative_cost_;
+        return p;
+    }
+
+    Vec3 normal() const
+    {
+        return Eigen::Map<const Vec3>(normal_);
+    }
+    void set_normal(const Vec3& n)
+    {
+        Eigen::Map<Vec3> normal(normal_);
+        normal = n;
+    }
+
+    V* position_;
+    V* normal_;
+    U8& normal_support_;
+    V& ground_diff_std_;
+    V& min_ground_diff_;
+    V& max_ground_diff_;
+    V& mean_abs_ground_diff_;
+    V* viewpoint_;
+    V& dist_to_actor_;
+    V& actor_last_visit_;
+    V& dist_to_other_actors_;
+    V& other_actors_last_visit_;
+    V& coverage_;
+    V& self_coverage_;
+    V& dist_to_obstacle_;
+    U8& flags_;
+    U8& num_empty_;
+    U8& num_occupied_;
+    V& dist_to_plane_;
+    U8& num_obstacle_pts_;
+    U8& num_obstacle_neighbors_;
+    U8& num_edge_neighbors_;
+    V& path_cost_;
+    V& reward_;
+    V& relative_cost_;
+};
+
+typedef PointRefT<false> PointRef;
+typedef PointRefT<true> ConstPointRef;
+
+/**
+ * Structure-of-arrays point storage with std::vector<Point> interface.
+ *
+ * Each Point member is kept in a separate contiguous array so that passes
+ * touching only a few members (positions, normals, flags) do not drag
+ * whole points through cache.
+ */
+class PointArrays
+{
+public:
+    typedef PointRef reference;
+    typedef ConstPointRef const_reference;
+
+    size_t size() const
+    {
+        return flags_.size();
+    }
+
+    bool empty() const
+    {
+        return flags_.empty();
+    }
+
+    size_t capacity() const
+    {
+        return flags_.capacity();
+    }
+
+    void reserve(size_t n)
+    {
+        position_.reserve(3 * n);
+        normal_.reserve(3 * n);
+        normal_support_.reserve(n);
+        ground_diff_std_.reserve(n);
+        min_ground_diff_.reserve(n);
+        max_ground_diff_.reserve(n);
+        mean_abs_ground_diff_.reserve(n);
+        viewpoint_.reserve(3 * n);
+        dist_to_actor_.reserve(n);
+        actor_last_visit_.reserve(n);
+        dist_to_other_actors_.reserve(n);
+        other_actors_last_visit_.reserve(n);
+        coverage_.reserve(n);
+        self_coverage_.reserve(n);
+        dist_to_obstacle_.reserve(n);
+        flags_.reserve(n);
+        num_empty_.reserve(n);
+        num_occupied_.reserve(n);
+        dist_to_plane_.reserve(n);
+        num_obstacle_pts_.reserve(n);
+        num_obstacle_neighbors_.reserve(n);
+        num_edge_neighbors_.reserve(n);
+        path_cost_.reserve(n);
+        reward_.reserve(n);
+        relative_cost_.reserve(n);
+    }
+
+    void clear()
+    {
+        position_.clear();
+        normal_.clear();
+        normal_support_.clear();
+        ground_diff_std_.clear();
+        min_ground_diff_.clear();
+        max_ground_diff_.clear();
+        mean_abs_ground_diff_.clear();
+        viewpoint_.clear();
+        dist_to_actor_.clear();
+        actor_last_visit_.clear();
+        dist_to_other_actors_.clear();
+        other_actors_last_visit_.clear();
+        coverage_.clear();
+        self_coverage_.clear();
+        dist_to_obstacle_.clear();
+        flags_.clear();
+        num_empty_.clear();
+        num_occupied_.clear();
+        dist_to_plane_.clear();
+        num_obstacle_pts_.clear();
+        num_obstacle_neighbors_.clear();
+        num_edge_neighbors_.clear();
+        path_cost_.clear();
+        reward_.clear();
+        relative_cost_.clear();
+    }
+
+    void push_back(const Point& p)
+    {
+        position_.insert(position_.end(), p.position_, p.position_ + 3);
+        normal_.insert(normal_.end(), p.normal_, p.normal_ + 3);
+        normal_support_.push_back(p.normal_support_);
+        ground_diff_std_.push_back(p.ground_diff_std_);
+        min_ground_diff_.push_back(p.min_ground_diff_);
+        max_ground_diff_.push_back(p.max_ground_diff_);
+        mean_abs_ground_diff_.push_back(p.mean_abs_ground_diff_);
+        viewpoint_.insert(viewpoint_.end(), p.viewpoint_, p.viewpoint_ + 3);
+        dist_to_actor_.push_back(p.dist_to_actor_);
+        actor_last_visit_.push_back(p.actor_last_visit_);
+        dist_to_other_actors_.push_back(p.dist_to_other_actors_);
+        other_actors_last_visit_.push_back(p.other_actors_last_visit_);
+        coverage_.push_back(p.coverage_);
+        self_coverage_.push_back(p.self_coverage_);
+        dist_to_obstacle_.push_back(p.dist_to_obstacle_);
+        flags_.push_back(p.flags_);
+        num_empty_.push_back(p.num_empty_);
+        num_occupied_.push_back(p.num_occupied_);
+        dist_to_plane_.push_back(p.dist_to_plane_);
+        num_obstacle_pts_.push_back(p.num_obstacle_pts_);
+        num_obstacle_neighbors_.push_back(p.num_obstacle_neighbors_);
+        num_edge_neighbors_.push_back(p.num_edge_neighbors_);
+        path_cost_.push_back(p.path_cost_);
+        reward_.push_back(p.reward_);
+        relative_cost_.push_back(p.relative_cost_);
+    }
+
+    PointRef operator[](size_t i)
+    {
+        return PointRef(*this, i);
+    }
+
+    ConstPointRef operator[](size_t i) const
+    {
+        return ConstPointRef(*this, i);
+    }
+
+    // Positions, normals, and viewpoints are stored as N-by-3 row-major
+    // (interleaved xyz) matrices, other members as N-vectors.
+    std::vector<Value> position_{};
+    std::vector<Value> normal_{};
+    std::vector<uint8_t> normal_support_{};
+    std::vector<Value> ground_diff_std_{};
+    std::vector<Value> min_ground_diff_{};
+    std::vector<Value> max_ground_diff_{};
+    std::vector<Value> mean_abs_ground_diff_{};
+    std::vector<Value> viewpoint_{};
+    std::vector<Value> dist_to_actor_{};
+    std::vector<Value> actor_last_visit_{};
+    std::vector<Value> dist_to_other_actors_{};
+    std::vector<Value> other_actors_last_visit_{};
+    std::vector<Value> coverage_{};
+    std::vector<Value> self_coverage_{};
+    std::vector<Value> dist_to_obstacle_{};
+    std::vector<uint8_t> flags_{};
+    std::vector<uint8_t> num_empty_{};
+    std::vector<uint8_t> num_occupied_{};
+    std::vector<Value> dist_to_plane_{};
+    std::vector<uint8_t> num_obstacle_pts_{};
+    std::vector<uint8_t> num_obstacle_neighbors_{};
+    std::vector<uint8_t> num_edge_neighbors_{};
+    std::vector<Value> path_cost_{};
+    std::vector<Value> reward_{};
+    std::vector<Value> relative_cost_{};
+};
+
+// Layout-specific views and copies, overloaded for both storage layouts.
+
+template<typename P>
+FlannMat position_matrix(std::vector<P>& cloud, Index start, Index size)
+{
+    return FlannMat(cloud[start].position_, static_cast<size_t>(size), 3, sizeof(P));
+}
+
+inline FlannMat position_matrix(PointArrays& cloud, Index start, Index size)
+{
+    return FlannMat(&cloud.position_[3 * start], static_cast<size_t>(size), 3);
+}
+
+/** Write point i as Point bytes to out. */
+inline void write_point(const std::vector<Point>& cloud, Index i, uint8_t* out)
+{
+    const auto from = reinterpret_cast<const uint8_t*>(&cloud[i]);
+    std::copy(from, from + sizeof(Point), out);
+}
+
+inline void write_point(const PointArrays& cloud, Index i, uint8_t* out)
+{
+    const Point p = cloud[i];
+    const auto from = reinterpret_cast<const uint8_t*>(&p);
+    std::copy(from, from + sizeof(Point), out);
+}
+
+/** Write all points as contiguous Point bytes to out. */
+inline void write_points(const std::vector<Point>& cloud, uint8_t* out)
+{
+    const auto from = reinterpret_cast<const uint8_t*>(cloud.data());
+    const auto to = reinterpret_cast<const uint8_t*>(cloud.data() + cloud.size());
+    std::copy(from, to, out);
+}
+
+inline void write_points(const PointArrays& cloud, uint8_t* out)
+{
+    for (Index i = 0; i < cloud.size(); ++i, out += sizeof(Point))
+    {
+        write_point(cloud, i, out);
+    }
+}
+
+}  // namespace naex
+
+#endif  // NAEX_POINT_ARRAYS_H
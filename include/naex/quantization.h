@@ -2,6 +2,9 @@
 #ifndef NAEX_QUANTIZATION_H
 #define NAEX_QUANTIZATION_H
 
+#include <cassert>
+#include <limits>
+
 namespace naex
 {
 
@@ -18,7 +21,7 @@ template<typename F, typename I>
 F reconstruct(I value, F scale)
 {
     const auto hi = std::numeric_limits<I>::max();
-    return value / hi * scale;
+    return static_cast<F>(value) / hi * scale;
 }
 
 template<typename F, typename I>
@@ -0,0 +1,139 @@
+#ifndef NAEX_RADIX_HEAP_H
+#define NAEX_RADIX_HEAP_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <naex/types.h>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace naex
+{
+
+/** Binary min-heap of (key, value) pairs, interface shared with RadixHeap. */
+template<typename V>
+using BinaryHeap = std::priority_queue<std::pair<Value, V>,
+                                       std::vector<std::pair<Value, V>>,
+                                       std::greater<std::pair<Value, V>>>;
+
+/**
+ * Monotone radix heap of (key, value) pairs with non-negative float keys.
+ *
+ * Non-negative floats order as their bit patterns, so keys are bucketed by
+ * the highest bit differing from the last extracted minimum. Each item moves
+ * to lower buckets at most 32 times, and insertion is O(1), which beats
+ * binary heaps on graphs with many relaxations per vertex.
+ *
+ * Keys must not be lower than the last extracted minimum, as in Dijkstra
+ * search. Lower keys, e.g., rounding errors of A* priorities, are queued as
+ * the last minimum, but keep their original value.
+ */
+template<typename V>
+class RadixHeap
+{
+public:
+    typedef std::pair<Value, V> Item;
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    void emplace(Value key, V value)
+    {
+        assert(key >= 0);
+        buckets_[bucket(bits(key))].emplace_back(key, value);
+        ++size_;
+    }
+
+    void push(const Item& item)
+    {
+        emplace(item.first, item.second);
+    }
+
+    /** Item with minimum key. */
+    const Item& top()
+    {
+        assert(!empty());
+        if (buckets_[0].empty())
+        {
+            pull();
+        }
+        return buckets_[0].back();
+    }
+
+    void pop()
+    {
+        top();
+        buckets_[0].pop_back();
+        --size_;
+    }
+
+    void clear()
+    {
+        for (auto& bucket: buckets_)
+        {
+            bucket.clear();
+        }
+        size_ = 0;
+        last_ = 0;
+    }
+
+private:
+    static const int NUM_BUCKETS = 33;
+
+    uint32_t bits(Value key) const
+    {
+        // Adding zero turns negative zero positive.
+        key += Value(0);
+        uint32_t b;
+        std::memcpy(&b, &key, sizeof(b));
+        return std::max(b, last_);
+    }
+
+    /** Bucket 0 holds keys equal to the last minimum, bucket i keys differing at bit i - 1. */
+    int bucket(uint32_t b) const
+    {
+        return b == last_ ? 0 : 32 - __builtin_clz(b ^ last_);
+    }
+
+    /** Redistribute the lowest non-empty bucket around its minimum. */
+    void pull()
+    {
+        int i = 1;
+        while (buckets_[i].empty())
+        {
+            ++i;
+        }
+        auto& items = buckets_[i];
+        uint32_t min_bits = bits(items.front().first);
+        for (const auto& item: items)
+        {
+            min_bits = std::min(min_bits, bits(item.first));
+        }
+        last_ = min_bits;
+        for (const auto& item: items)
+        {
+            buckets_[bucket(bits(item.first))].push_back(item);
+        }
+        items.clear();
+    }
+
+    std::vector<Item> buckets_[NUM_BUCKETS];
+    size_t size_{0};
+    // Bits of the last minimum key.
+    uint32_t last_{0};
+};
+
+}  // namespace naex
+
+#endif  // NAEX_RADIX_HEAP_H
@@ -0,0 +1,191 @@
+#ifndef NAEX_RANGE_IMAGE_H
+#define NAEX_RANGE_IMAGE_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <naex/clouds.h>
+#include <naex/timer.h>
+#include <naex/types.h>
+#include <ros/ros.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <vector>
+
+namespace naex
+{
+
+/**
+ * Depth image of a scan rasterized with a spherical projection, for testing
+ * map points against the scan by depth lookups.
+ *
+ * Each pixel keeps the nearest depth of scan points projected to it.
+ * As a map point may lie anywhere within its pixel, it is tested against near
+ * and far depths over the 3x3 neighborhood of the pixel, which tolerates
+ * surfaces seen at grazing angles. Pyramids of minimum near and maximum far
+ * depths bound depths over pixel rectangles, e.g., to test whole voxels.
+ *
+ * Near depths are -inf and far depths inf without any return around.
+ */
+class RangeImage
+{
+public:
+    int height() const
+    {
+        return height_;
+    }
+
+    int width() const
+    {
+        return width_;
+    }
+
+    /** Rasterize scan points into nearest depths and build depth pyramids. */
+    void rasterize(const sensor_msgs::PointCloud2& cloud, const SphericalProjection& model)
+    {
+        Timer t;
+        height_ = int(cloud.height);
+        width_ = int(cloud.width);
+        const Value inf = std::numeric_limits<Value>::infinity();
+        depth_.assign(size_t(height_) * width_, inf);
+        sensor_msgs::PointCloud2ConstIterator<float> x_it(cloud, "x");
+        const size_t n = num_points(cloud);
+        for (size_t i = 0; i < n; ++i, ++x_it)
+        {
+            if (!std::isfinite(x_it[0]) || !std::isfinite(x_it[1]) || !std::isfinite(x_it[2]))
+                continue;
+            int r, c;
+            if (!pixel(model, x_it[0], x_it[1], x_it[2], r, c))
+                continue;
+            auto& depth = depth_[r * width_ + c];
+            depth = std::min(depth, std::sqrt(x_it[0] * x_it[0] + x_it[1] * x_it[1] + x_it[2] * x_it[2]));
+        }
+
+        levels_.resize(1);
+        auto& base = levels_[0];
+        base.height = height_;
+        base.width = width_;
+        base.near.assign(depth_.size(), -inf);
+        base.far.assign(depth_.size(), inf);
+        #pragma omp parallel for schedule(static)
+        for (int r = 0; r < height_; ++r)
+        {
+            for (int c = 0; c < width_; ++c)
+            {
+                Value near = inf;
+                Value far = -inf;
+                for (int i = std::max(r - 1, 0); i <= std::min(r + 1, height_ - 1); ++i)
+                {
+                    for (int j = std::max(c - 1, 0); j <= std::min(c + 1, width_ - 1); ++j)
+                    {
+                        const Value depth = depth_[i * width_ + j];
+                        if (std::isfinite(depth))
+                        {
+                            near = std::min(near, depth);
+                            far = std::max(far, depth);
+                        }
+                    }
+                }
+                if (far >= near)
+                {
+                    base.near[r * width_ + c] = near;
+                    base.far[r * width_ + c] = far;
+                }
+            }
+        }
+
+        while (levels_.back().height > 1 || levels_.back().width > 1)
+        {
+            const Level& fine = levels_.back();
+            Level coarse;
+            coarse.height = (fine.height + 1) / 2;
+            coarse.width = (fine.width + 1) / 2;
+            coarse.near.assign(size_t(coarse.height) * coarse.width, inf);
+            coarse.far.assign(size_t(coarse.height) * coarse.width, -inf);
+            for (int r = 0; r < fine.height; ++r)
+            {
+                for (int c = 0; c < fine.width; ++c)
+                {
+                    const int k = (r / 2) * coarse.width + c / 2;
+                    coarse.near[k] = std::min(coarse.near[k], fine.near[r * fine.width + c]);
+                    coarse.far[k] = std::max(coarse.far[k], fine.far[r * fine.width + c]);
+                }
+            }
+            levels_.push_back(std::move(coarse));
+        }
+        ROS_DEBUG("Range image %i x %i with %lu levels rasterized (%.6f s).",
+                  height_, width_, levels_.size(), t.seconds_elapsed());
+    }
+
+    /** Pixel of point in sensor frame, false if outside the image. */
+    bool pixel(const SphericalProjection& model, Value x, Value y, Value z, int& r, int& c) const
+    {
+        Value r_model, c_model;
+        model.lookup(x, y, z, r_model, c_model);
+        r_model = std::round(r_model);
+        c_model = std::round(c_model);
+        if (!(r_model >= 0 && r_model < height_ && c_model >= 0 && c_model < width_))
+        {
+            return false;
+        }
+        r = int(r_model);
+        c = int(c_model);
+        return true;
+    }
+
+    /** Nearest depth around pixel. */
+    Value near(int r, int c) const
+    {
+        return levels_[0].near[r * width_ + c];
+    }
+
+    /** Farthest depth around pixel. */
+    Value far(int r, int c) const
+    {
+        return levels_[0].far[r * width_ + c];
+    }
+
+    /**
+     * Bounds on near and far depths over pixels [r0, r1] x [c0, c1],
+     * from the coarsest pyramid level covering it with 2x2 cells.
+     */
+    void bounds(int r0, int c0, int r1, int c1, Value& near, Value& far) const
+    {
+        size_t l = 0;
+        while (l + 1 < levels_.size() && ((r1 >> l) - (r0 >> l) > 1 || (c1 >> l) - (c0 >> l) > 1))
+        {
+            ++l;
+        }
+        const Level& level = levels_[l];
+        near = std::numeric_limits<Value>::infinity();
+        far = -std::numeric_limits<Value>::infinity();
+        for (int r = r0 >> l; r <= std::min(r1 >> l, level.height - 1); ++r)
+        {
+            for (int c = c0 >> l; c <= std::min(c1 >> l, level.width - 1); ++c)
+            {
+                near = std::min(near, level.near[r * level.width + c]);
+                far = std::max(far, level.far[r * level.width + c]);
+            }
+        }
+    }
+
+private:
+    struct Level
+    {
+        int height{0};
+        int width{0};
+        std::vector<Value> near{};
+        std::vector<Value> far{};
+    };
+
+    int height_{0};
+    int width_{0};
+    // Nearest depth per pixel, inf without return.
+    std::vector<Value> depth_{};
+    // Near and far depths around pixels, coarser levels over 2x2 cells.
+    std::vector<Level> levels_{};
+};
+
+}  // namespace naex
+
+#endif  // NAEX_RANGE_IMAGE_H
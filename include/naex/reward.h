@@ -5,6 +5,7 @@
 #include <mutex>
 #include <naex/flann.h>
 #include <naex/types.h>
+#include <queue>
 #include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
 //#include <set>
@@ -22,14 +23,14 @@ T clamp(T x, T lo, T hi)
 }
 
 template<typename P>
-void suppress_reward(P& point)
+void suppress_reward(P&& point)
 {
     if (point.position_[0] >= -60. && point.position_[0] <= 0.
         && point.position_[1] >= -30. && point.position_[1] <= 30.
         && point.position_[2] >= -30. && point.position_[2] <= 30.)
     {
         Value dist_from_origin = ConstVec3Map(point.position_).norm();
-        point.reward_ /= (1. + std::pow(dist_from_origin, 2.f));
+        point.reward_ = Value(point.reward_) / (1 + std::pow(dist_from_origin, 2.f));
     }
 }
 
@@ -75,8 +76,8 @@ public:
 };
 
 /// Update point rewards at given indices using new viewpoints.
-template<typename P>
-void update_coverage(std::vector<P>& points,
+template<typename C>
+void update_coverage(C& points,
                      const std::vector<Index>& indices,
    //                const std::vector<std::vector<size_t>>& neighborhood,
                      const std::vector<Vec3>& viewpoints,
@@ -89,7 +90,7 @@ void update_coverage(std::vector<P>& points,
     Timer t;
     for (const auto& i: indices)
     {
-        auto& p = points[i];
+        auto&& p = points[i];
         ConstVec3Map p_vec(p.position_);
         for (const auto& vp: viewpoints)
         {
@@ -102,11 +103,11 @@ void update_coverage(std::vector<P>& points,
             const auto c = distance_coverage(dist, mean, std);
             if (coverage)
             {
-                p.coverage_ = update_coverage(p.coverage_, c);
+                p.coverage_ = update_coverage<Value>(p.coverage_, c);
             }
             if (self_coverage)
             {
-                p.self_coverage_ = update_coverage(p.self_coverage_, c);
+                p.self_coverage_ = update_coverage<Value>(p.self_coverage_, c);
             }
         }
     }
@@ -115,9 +116,9 @@ void update_coverage(std::vector<P>& points,
 }
 
 /// Collect rewards at given indices using given neighborhood.
-template<typename P>
+template<typename C>
 //void collect_rewards(points, indices, neighborhood, float max_collect_dist = 10.0f)
-void collect_rewards(std::vector<P>& points,
+void collect_rewards(C& points,
                      const std::vector<Index>& indices,
                      const std::vector<std::vector<Index>>& neighborhood,
                      Value mean = 3.0,
@@ -130,8 +131,9 @@ void collect_rewards(std::vector<P>& points,
     for (size_t i = 0; i < indices.size(); ++i)
     {
         const auto& v_i = indices[i];
-        auto& p_i = points[v_i];
-        p_i.reward_ = 0;
+        auto&& p_i = points[v_i];
+        // Accumulate in full precision, points may store rewards quantized.
+        Value reward_sum = 0;
         for (const auto& v_j: neighborhood[i])
         {
             const auto& p_j = points[v_j];
@@ -141,20 +143,21 @@ void collect_rewards(std::vector<P>& points,
                 continue;
             }
             // Add the difference of previous coverage and the tested new one.
-//            p_i.reward_ += update_coverage(p_j.coverage_, distance_coverage(dist, mean, std)) - p_j.coverage_;
-            const Value new_coverage = update_coverage(p_j.coverage_, distance_coverage(dist, mean, std));
-            const Value new_self_coverage = update_coverage(p_j.self_coverage_, distance_coverage(dist, mean, std));
+//            p_i.reward_ += update_coverage<Value>(p_j.coverage_, distance_coverage(dist, mean, std)) - p_j.coverage_;
+            const Value new_coverage = update_coverage<Value>(p_j.coverage_, distance_coverage(dist, mean, std));
+            const Value new_self_coverage = update_coverage<Value>(p_j.self_coverage_, distance_coverage(dist, mean, std));
             const Value reward = new_coverage - p_j.coverage_;
             const Value self_reward = new_self_coverage - p_j.self_coverage_;
-            p_i.reward_ += std::max(reward, self_factor * self_reward);
+            reward_sum += std::max(reward, self_factor * self_reward);
         }
+        p_i.reward_ = reward_sum;
     }
     ROS_DEBUG("Coverage rewards collected for %lu points (%.3f s).",
               indices.size(), t.seconds_elapsed());
 }
 
-template<typename P>
-void collect_rewards(std::vector<P>& points,
+template<typename C>
+void collect_rewards(C& points,
                      const std::vector<Index>& indices,
                      Value mean = 3.0,
                      Value std = 1.5,
@@ -272,7 +275,7 @@ void collect_rewards(std::vector<P>& points,
             continue;
         }
         // Assume constant rewards from all represented points.
-        auto& pt = points[indices[i]];
+        auto&& pt = points[indices[i]];
         pt.reward_ = r_ptr->support_ * r_ptr->reward_;
         if (suppress_base_reward)
         {
@@ -284,4 +287,68 @@ void collect_rewards(std::vector<P>& points,
              indices.size(), reward_pts.size(), bin_size, t.seconds_elapsed());
 }
 
+/**
+ * Maximum reward over points, kept in a max-heap as rewards change.
+ *
+ * Entries are pushed on each update and dropped once found outdated at the
+ * top, the heap is rebuilt from points if outdated entries dominate.
+ * Rewards not yet collected (NaN) are not pushed, as they would break
+ * the heap order.
+ */
+class RewardBound
+{
+public:
+    void clear()
+    {
+        heap_ = Heap();
+    }
+
+    /** Record rewards of points at given indices. */
+    template<typename C>
+    void update(const C& points, const std::vector<Index>& indices)
+    {
+        for (const auto i: indices)
+        {
+            push(heap_, points, i);
+        }
+    }
+
+    /** Maximum reward of points, zero if none is positive. */
+    template<typename C>
+    Value max(const C& points)
+    {
+        if (heap_.size() > 2 * points.size() + 1024)
+        {
+            Heap heap;
+            for (Index i = 0; i < Index(points.size()); ++i)
+            {
+                push(heap, points, i);
+            }
+            heap_.swap(heap);
+        }
+        while (!heap_.empty()
+               && (size_t(heap_.top().second) >= points.size()
+                   || !(Value(points[heap_.top().second].reward_) == heap_.top().first)))
+        {
+            heap_.pop();
+        }
+        return heap_.empty() ? Value(0) : std::max(heap_.top().first, Value(0));
+    }
+
+private:
+    typedef std::priority_queue<std::pair<Value, Index>> Heap;
+
+    template<typename C>
+    static void push(Heap& heap, const C& points, Index i)
+    {
+        const Value reward = Value(points[i].reward_);
+        if (std::isfinite(reward))
+        {
+            heap.emplace(reward, i);
+        }
+    }
+
+    Heap heap_{};
+};
+
 }  // namespace naex
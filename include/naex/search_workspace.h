@@ -0,0 +1,144 @@
+#ifndef NAEX_SEARCH_WORKSPACE_H
+#define NAEX_SEARCH_WORKSPACE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <naex/types.h>
+#include <vector>
+
+namespace naex
+{
+
+/**
+ * Path costs and predecessors of graph searches, kept between searches.
+ *
+ * Each entry is stamped with the epoch of the search which set it, so that
+ * starting a new search takes constant time instead of reinitializing all
+ * vertices. Buffers only grow with the map and are not reallocated per plan.
+ *
+ * Searches sharing the workspace overwrite each other's results. A search
+ * can tell whether its results are still there by comparing epochs.
+ *
+ * Dijkstra and delta-stepping searches also record the vertices they settle,
+ * so that their results can be read without a pass over all vertices.
+ */
+class SearchWorkspace
+{
+public:
+    typedef uint32_t Epoch;
+
+    /**
+     * Start a new search over n vertices, all unreached.
+     * @return Epoch of the new search.
+     */
+    Epoch reset(size_t n)
+    {
+        resize(n);
+        settled_.clear();
+        if (++epoch_ == 0)
+        {
+            // Clear stamps once the epoch wraps around.
+            for (auto& entry: entries_)
+            {
+                entry.epoch = 0;
+            }
+            std::fill(settled_epochs_.begin(), settled_epochs_.end(), Epoch(0));
+            epoch_ = 1;
+        }
+        return epoch_;
+    }
+
+    /** Extend current search to n vertices, new ones unreached. */
+    void resize(size_t n)
+    {
+        if (n > entries_.size())
+        {
+            entries_.resize(n);
+            settled_epochs_.resize(n, 0);
+        }
+        size_ = n;
+    }
+
+    Epoch epoch() const
+    {
+        return epoch_;
+    }
+
+    /** Number of vertices of current search. */
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool reached(Vertex v) const
+    {
+        return entries_[v].epoch == epoch_;
+    }
+
+    /** Path cost from source, infinite if not reached. */
+    Value path_cost(Vertex v) const
+    {
+        return reached(v) ? entries_[v].path_cost : std::numeric_limits<Value>::infinity();
+    }
+
+    /** Predecessor on path, source for source, invalid if not reached. */
+    Vertex predecessor(Vertex v) const
+    {
+        return reached(v) ? entries_[v].predecessor : INVALID_VERTEX;
+    }
+
+    void set(Vertex v, Value path_cost, Vertex predecessor)
+    {
+        auto& entry = entries_[v];
+        entry.path_cost = path_cost;
+        entry.predecessor = predecessor;
+        entry.epoch = epoch_;
+    }
+
+    /** Mark vertex unreached again. */
+    void unset(Vertex v)
+    {
+        entries_[v].epoch = 0;
+    }
+
+    /** Record reached vertex v as settled, once per search. */
+    void settle(Vertex v)
+    {
+        if (settled_epochs_[v] != epoch_)
+        {
+            settled_epochs_[v] = epoch_;
+            settled_.push_back(v);
+        }
+    }
+
+    /**
+     * Vertices settled by current search, each listed once.
+     * Vertices unset since stay listed, unreached.
+     */
+    const std::vector<Vertex>& settled() const
+    {
+        return settled_;
+    }
+
+private:
+    // Fields used together in relaxation share a cache line.
+    struct Entry
+    {
+        Value path_cost{std::numeric_limits<Value>::infinity()};
+        Vertex predecessor{INVALID_VERTEX};
+        Epoch epoch{0};
+    };
+
+    Epoch epoch_{0};
+    size_t size_{0};
+    std::vector<Entry> entries_{};
+    // Settled vertices are stamped apart from entries, which are read in
+    // relaxation.
+    std::vector<Epoch> settled_epochs_{};
+    std::vector<Vertex> settled_{};
+};
+
+}  // namespace naex
+
+#endif  // NAEX_SEARCH_WORKSPACE_H
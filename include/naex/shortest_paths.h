@@ -0,0 +1,528 @@
+#ifndef NAEX_SHORTEST_PATHS_H
+#define NAEX_SHORTEST_PATHS_H
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <naex/map.h>
+#include <naex/radix_heap.h>
+#include <naex/search_workspace.h>
+#include <naex/types.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace naex
+{
+
+/** Limits terminating shortest-path search early. */
+struct SearchLimits
+{
+    // Vertices with higher path costs are left unreached.
+    Value max_cost{std::numeric_limits<Value>::infinity()};
+    // Maximum number of vertices expanded, zero for no limit.
+    size_t max_expanded{0};
+    // Stop once the goal vertex is settled.
+    Vertex goal{INVALID_VERTEX};
+    // Called with each settled vertex and its path cost, in order of
+    // increasing path cost, stop once it returns true.
+    std::function<bool(Vertex, Value)> stop{};
+
+    /** Whether search may stop before settling all vertices within max cost. */
+    bool partial() const
+    {
+        return max_expanded > 0 || goal != INVALID_VERTEX || bool(stop);
+    }
+};
+
+/**
+ * Single-source shortest paths in the map graph, repaired incrementally
+ * between plans.
+ *
+ * Path costs and predecessors are kept from the previous search. While the
+ * source stays the same, only vertices affected by recomputed edge costs
+ * are updated: shortest-path subtrees hanging on removed or more expensive
+ * tree edges are invalidated and re-seeded from their boundary, and cheaper
+ * edges are relaxed, both followed by Dijkstra propagation. Otherwise, and if
+ * most of the tree is invalidated, paths are computed from scratch.
+ *
+ * Vertices beyond the maximum path cost are left unreached, which is kept
+ * consistent by the repair as long as the limit does not change. Searches
+ * stopped at the goal or after given number of expansions are not repaired
+ * but recomputed next time.
+ *
+ * The shortest-path tree is kept as child lists, so that only subtrees below
+ * changed vertices are walked. Neighborhoods are not symmetric, due to the
+ * limit on the number of neighbors, so invalidated vertices are re-seeded
+ * from their incoming edges, indexed when paths are computed from scratch
+ * and extended with out edges of changed vertices since.
+ *
+ * Paths are kept in a workspace shared with other searches, if another search
+ * used it meanwhile, paths are computed from scratch.
+ *
+ * @tparam Q Min-priority queue of (path cost, vertex) pairs,
+ *     BinaryHeap or RadixHeap.
+ */
+template<typename Q>
+class IncrementalShortestPathsT
+{
+public:
+    typedef Q Queue;
+
+    explicit IncrementalShortestPathsT(SearchWorkspace& workspace):
+        workspace_(workspace)
+    {}
+
+    /** Drop previous search, e.g., when vertex indices change meaning. */
+    void reset()
+    {
+        source_ = INVALID_VERTEX;
+        complete_ = false;
+    }
+
+    Vertex source() const
+    {
+        return source_;
+    }
+
+    /** Path costs and predecessors from source, valid until another search uses the workspace. */
+    const SearchWorkspace& workspace() const
+    {
+        return workspace_;
+    }
+
+    /** Whether vertex v has been settled, i.e., its path is optimal. */
+    bool settled(Vertex v) const
+    {
+        return valid() && size_t(v) < workspace_.size() && workspace_.reached(v)
+               && !(workspace_.path_cost(v) > settled_cost_);
+    }
+
+    /**
+     * Whether settled paths from source are still optimal after edge costs
+     * of changed vertices were recomputed, i.e., no changed vertex was
+     * settled. Paths through unsettled vertices cannot get cheaper than
+     * settled paths.
+     */
+    bool reusable(Vertex source, const std::vector<Vertex>& changed) const
+    {
+        if (source != source_ || !valid())
+        {
+            return false;
+        }
+        for (const auto v: changed)
+        {
+            if (settled(v))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Compute paths from scratch.
+     * @return Number of vertices settled.
+     */
+    size_t compute(const Map& map, Vertex source, const SearchLimits& limits = SearchLimits())
+    {
+        const size_t n = size_t(map.num_vertices());
+        source_ = source;
+        limits_ = limits;
+        epoch_ = workspace_.reset(n);
+        // Only complete searches are repaired later.
+        track_tree_ = !limits.partial();
+        if (track_tree_)
+        {
+            resize_tree(n);
+            index_in_edges(map);
+        }
+        set_path(source, 0, source);
+        Queue queue;
+        queue.emplace(Value(0), source);
+        const size_t n_settled = propagate(map, queue);
+        // The callback may refer to state of the caller.
+        limits_.stop = nullptr;
+        return n_settled;
+    }
+
+    /**
+     * Update paths after edge costs of changed vertices were recomputed.
+     * @return Number of vertices with updated path costs.
+     */
+    size_t update(const Map& map, Vertex source, const std::vector<Vertex>& changed,
+                  const SearchLimits& limits = SearchLimits())
+    {
+        const size_t n = size_t(map.num_vertices());
+        // Keep previous search if the changes do not reach settled vertices.
+        if (!limits.stop && !stopped_ && limits.max_cost == limits_.max_cost
+                && limits.max_expanded == limits_.max_expanded && limits.goal == limits_.goal
+                && n >= workspace_.size() && reusable(source, changed))
+        {
+            workspace_.resize(n);
+            if (track_tree_)
+            {
+                resize_tree(n);
+                add_in_edges(map, changed);
+            }
+            return 0;
+        }
+        if (!complete_ || !track_tree_ || limits.partial() || !(limits.max_cost == limits_.max_cost)
+                || source != source_ || !valid() || n < workspace_.size())
+        {
+            return compute(map, source, limits);
+        }
+        workspace_.resize(n);
+        resize_tree(n);
+        add_in_edges(map, changed);
+
+        // Tree edges from changed vertices, which were removed or got more
+        // expensive, invalidate the subtrees below.
+        std::vector<Vertex> stack;
+        for (const auto u: changed)
+        {
+            if (size_t(u) >= n || !workspace_.reached(u))
+            {
+                continue;
+            }
+            for (Vertex w = first_child_[u]; w != INVALID_VERTEX; w = next_sibling_[w])
+            {
+                const auto e = find_edge(map, u, w);
+                if (e == INVALID_EDGE || !(workspace_.path_cost(u) + map.edge_cost(e) <= workspace_.path_cost(w)))
+                {
+                    stack.push_back(w);
+                }
+            }
+        }
+        std::vector<Vertex> invalid;
+        while (!stack.empty())
+        {
+            const auto v = stack.back();
+            stack.pop_back();
+            if (!workspace_.reached(v))
+            {
+                continue;
+            }
+            for (Vertex w = first_child_[v]; w != INVALID_VERTEX; w = next_sibling_[w])
+            {
+                stack.push_back(w);
+            }
+            unlink(v);
+            workspace_.unset(v);
+            invalid.push_back(v);
+        }
+        if (2 * invalid.size() > n)
+        {
+            return compute(map, source, limits);
+        }
+
+        // Seed from valid vertices with edges into the invalidated region
+        // and from edges of changed vertices.
+        Queue queue;
+        for (const auto v: invalid)
+        {
+            for_each_in_edge(map, v, [&](Vertex u, Edge e)
+            {
+                if (workspace_.reached(u))
+                {
+                    relax(map, u, e, queue);
+                }
+            });
+        }
+        for (const auto u: changed)
+        {
+            if (size_t(u) >= n || !workspace_.reached(u))
+            {
+                continue;
+            }
+            const auto edges = map.out_edges(u);
+            for (Edge e = *edges.first; e != *edges.second; ++e)
+            {
+                relax(map, u, e, queue);
+            }
+        }
+        return invalid.size() + propagate(map, queue);
+    }
+
+private:
+    static const Edge INVALID_EDGE = std::numeric_limits<Edge>::max();
+
+    static Edge find_edge(const Map& map, Vertex u, Vertex v)
+    {
+        const auto edges = map.out_edges(u);
+        for (Edge e = *edges.first; e != *edges.second; ++e)
+        {
+            if (map.target(e) == v)
+            {
+                return e;
+            }
+        }
+        return INVALID_EDGE;
+    }
+
+    /** Set path to v via predecessor u, keeping the tree up to date. */
+    inline void set_path(Vertex v, Value cost, Vertex u)
+    {
+        if (track_tree_)
+        {
+            if (!workspace_.reached(v))
+            {
+                first_child_[v] = INVALID_VERTEX;
+                link(v, u);
+            }
+            else if (workspace_.predecessor(v) != u)
+            {
+                unlink(v);
+                link(v, u);
+            }
+        }
+        workspace_.set(v, cost, u);
+    }
+
+    void resize_tree(size_t n)
+    {
+        if (first_child_.size() < n)
+        {
+            first_child_.resize(n, INVALID_VERTEX);
+            next_sibling_.resize(n, INVALID_VERTEX);
+            prev_sibling_.resize(n, INVALID_VERTEX);
+        }
+    }
+
+    /** Prepend v to children of u, source has no siblings. */
+    inline void link(Vertex v, Vertex u)
+    {
+        prev_sibling_[v] = INVALID_VERTEX;
+        if (u == v)
+        {
+            next_sibling_[v] = INVALID_VERTEX;
+            return;
+        }
+        next_sibling_[v] = first_child_[u];
+        if (first_child_[u] != INVALID_VERTEX)
+        {
+            prev_sibling_[first_child_[u]] = v;
+        }
+        first_child_[u] = v;
+    }
+
+    /** Remove reached vertex v from children of its predecessor. */
+    inline void unlink(Vertex v)
+    {
+        const auto u = workspace_.predecessor(v);
+        if (u == v)
+        {
+            return;
+        }
+        const auto prev = prev_sibling_[v];
+        const auto next = next_sibling_[v];
+        if (prev == INVALID_VERTEX)
+        {
+            first_child_[u] = next;
+        }
+        else
+        {
+            next_sibling_[prev] = next;
+        }
+        if (next != INVALID_VERTEX)
+        {
+            prev_sibling_[next] = prev;
+        }
+    }
+
+    /** Index sources of incoming edges of all vertices. */
+    void index_in_edges(const Map& map)
+    {
+        const Vertex n = Vertex(map.num_vertices());
+        in_begin_.assign(size_t(n) + 1, 0);
+        for (Vertex u = 0; u < n; ++u)
+        {
+            for (Edge e = map.graph_.out_begin(u); e < map.graph_.out_end(u); ++e)
+            {
+                ++in_begin_[map.graph_.targets_[e] + 1];
+            }
+        }
+        for (Vertex v = 0; v < n; ++v)
+        {
+            in_begin_[v + 1] += in_begin_[v];
+        }
+        in_sources_.resize(in_begin_[n]);
+        std::vector<size_t> pos(in_begin_.begin(), in_begin_.end() - 1);
+        for (Vertex u = 0; u < n; ++u)
+        {
+            for (Edge e = map.graph_.out_begin(u); e < map.graph_.out_end(u); ++e)
+            {
+                in_sources_[pos[map.graph_.targets_[e]]++] = u;
+            }
+        }
+        in_added_.clear();
+        num_in_added_ = 0;
+    }
+
+    /**
+     * Add out edges of changed vertices to incoming edges, entries which are
+     * no longer valid are skipped on lookup. Index is rebuilt if most
+     * entries were added since.
+     */
+    void add_in_edges(const Map& map, const std::vector<Vertex>& changed)
+    {
+        for (const auto u: changed)
+        {
+            if (size_t(u) >= size_t(map.num_vertices()))
+            {
+                continue;
+            }
+            for (Edge e = map.graph_.out_begin(u); e < map.graph_.out_end(u); ++e)
+            {
+                in_added_[map.graph_.targets_[e]].push_back(u);
+                ++num_in_added_;
+            }
+        }
+        if (num_in_added_ > in_sources_.size())
+        {
+            index_in_edges(map);
+        }
+    }
+
+    /** Call f(u, e) for each current edge e from u to v. */
+    template<typename F>
+    void for_each_in_edge(const Map& map, Vertex v, F f) const
+    {
+        const auto visit = [&](Vertex u)
+        {
+            const auto e = find_edge(map, u, v);
+            if (e != INVALID_EDGE)
+            {
+                f(u, e);
+            }
+        };
+        if (size_t(v) + 1 < in_begin_.size())
+        {
+            for (size_t i = in_begin_[v]; i < in_begin_[v + 1]; ++i)
+            {
+                visit(in_sources_[i]);
+            }
+        }
+        const auto it = in_added_.find(v);
+        if (it != in_added_.end())
+        {
+            for (const auto u: it->second)
+            {
+                visit(u);
+            }
+        }
+    }
+
+    inline bool relax(const Map& map, Vertex u, Edge e, Queue& queue)
+    {
+        const auto v = map.target(e);
+        const Value cost = workspace_.path_cost(u) + map.edge_cost(e);
+        if (!(cost < workspace_.path_cost(v)) || cost > limits_.max_cost)
+        {
+            return false;
+        }
+        set_path(v, cost, u);
+        queue.emplace(cost, v);
+        return true;
+    }
+
+    /**
+     * Dijkstra propagation, returns number of vertices settled.
+     * Vertices left in the queue keep tentative costs and predecessors.
+     */
+    size_t propagate(const Map& map, Queue& queue)
+    {
+        const Vertex* targets = map.graph_.targets_.data();
+        const Value* costs = map.graph_.costs_.data();
+        size_t n = 0;
+        complete_ = true;
+        stopped_ = false;
+        settled_cost_ = std::numeric_limits<Value>::infinity();
+        while (!queue.empty())
+        {
+            const auto item = queue.top();
+            // Skip outdated entries.
+            if (item.first > workspace_.path_cost(item.second))
+            {
+                queue.pop();
+                continue;
+            }
+            if (limits_.max_expanded > 0 && n >= limits_.max_expanded)
+            {
+                complete_ = false;
+                // Only vertices below the queue top are settled.
+                settled_cost_ = std::nextafter(item.first, -std::numeric_limits<Value>::infinity());
+                break;
+            }
+            queue.pop();
+            const auto u = item.second;
+            ++n;
+            workspace_.settle(u);
+            if (u == limits_.goal)
+            {
+                complete_ = false;
+                settled_cost_ = item.first;
+                break;
+            }
+            if (limits_.stop && limits_.stop(u, item.first))
+            {
+                complete_ = false;
+                stopped_ = true;
+                settled_cost_ = item.first;
+                break;
+            }
+            // Relax inline on raw edge arrays, leaving costs not computed
+            // yet (NaN) and invalid ones to edge_cost.
+            const Value cost_u = item.first;
+            const Edge end = map.graph_.out_end(u);
+            for (Edge e = map.graph_.out_begin(u); e < end; ++e)
+            {
+                const Vertex v = targets[e];
+                const Value cost = cost_u + (costs[e] > 0 ? costs[e] : map.edge_cost(e));
+                if (cost < workspace_.path_cost(v) && !(cost > limits_.max_cost))
+                {
+                    set_path(v, cost, u);
+                    queue.emplace(cost, v);
+                }
+            }
+        }
+        return n;
+    }
+
+    /** Whether the workspace still holds paths of this search. */
+    bool valid() const
+    {
+        return source_ != INVALID_VERTEX && workspace_.epoch() == epoch_;
+    }
+
+    SearchWorkspace& workspace_;
+    // Epoch of the workspace holding paths from source.
+    SearchWorkspace::Epoch epoch_{0};
+    Vertex source_{INVALID_VERTEX};
+    SearchLimits limits_{};
+    // Whether all vertices within max. cost were settled.
+    bool complete_{false};
+    // Whether the search was stopped by the callback.
+    bool stopped_{false};
+    // Path costs up to this one are optimal.
+    Value settled_cost_{std::numeric_limits<Value>::infinity()};
+    // Shortest-path tree as doubly linked child lists, maintained for
+    // complete searches only, valid for reached vertices.
+    bool track_tree_{false};
+    std::vector<Vertex> first_child_{};
+    std::vector<Vertex> next_sibling_{};
+    std::vector<Vertex> prev_sibling_{};
+    // Sources of incoming edges, indexed in CSR from a full graph pass,
+    // and added from changed vertices since.
+    std::vector<size_t> in_begin_{};
+    std::vector<Vertex> in_sources_{};
+    std::unordered_map<Vertex, std::vector<Vertex>> in_added_{};
+    size_t num_in_added_{0};
+};
+
+typedef IncrementalShortestPathsT<RadixHeap<Vertex>> IncrementalShortestPaths;
+
+}  // namespace naex
+
+#endif  // NAEX_SHORTEST_PATHS_H
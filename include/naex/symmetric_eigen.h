@@ -0,0 +1,265 @@
+#ifndef NAEX_SYMMETRIC_EIGEN_H
+#define NAEX_SYMMETRIC_EIGEN_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <Eigen/Dense>
+#include <limits>
+#include <naex/types.h>
+#include <vector>
+
+namespace naex
+{
+
+/**
+ * Arc cosine for x in [-1, 1], within 3e-8 rad.
+ * Branch-free, so that loops using it vectorize.
+ */
+template<typename T>
+T inline fast_acos(T x)
+{
+    const T a = std::abs(x);
+    // Abramowitz and Stegun 4.4.46, acos(a) = sqrt(1 - a) poly(a) on [0, 1].
+    const T r = std::sqrt(T(1) - a) * (T(1.5707963050) + a * (T(-0.2145988016) + a * (T(0.0889789874)
+            + a * (T(-0.0501743046) + a * (T(0.0308918810) + a * (T(-0.0170881256)
+            + a * (T(0.0066700901) + a * T(-0.0012624911))))))));
+    return x < 0 ? T(M_PI) - r : r;
+}
+
+/**
+ * Cosine for x in [0, pi], within 1e-11.
+ * Branch-free, so that loops using it vectorize.
+ */
+template<typename T>
+T inline fast_cos(T x)
+{
+    // cos(x) = -sin(x - pi / 2), Taylor polynomial of sin on [-pi / 2, pi / 2].
+    const T u = x - T(M_PI_2);
+    const T s = u * u;
+    return -u * (T(1) + s * (T(-1) / 6 + s * (T(1) / 120 + s * (T(-1) / 5040 + s * (T(1) / 362880
+            + s * (T(-1) / 39916800 + s * (T(1) / 6227020800 + s * T(-1) / 1307674368000)))))));
+}
+
+/**
+ * Maximum and minimum taking arguments by value, std::max and std::min bind
+ * references, which keeps the arguments in memory inside omp simd loops.
+ */
+template<typename T>
+T inline simd_max(T a, T b)
+{
+    return a < b ? b : a;
+}
+
+template<typename T>
+T inline simd_min(T a, T b)
+{
+    return b < a ? b : a;
+}
+
+/**
+ * Smallest eigenpairs of symmetric 3x3 matrices in closed form.
+ *
+ * Each matrix is shifted by its mean eigenvalue and scaled, eigenvalues are
+ * found analytically as roots of the characteristic cubic, and eigenvector
+ * as the largest cross product of rows of A - lambda I.
+ * Written without branches on data so that the loop over matrices vectorizes.
+ *
+ * Matrix i is given by its upper triangle a00[i], ..., a22[i], the eigenvalue
+ * and unit eigenvector are written to value[i] and x[i], y[i], z[i].
+ * Arrays must not overlap.
+ *
+ * Results which are not well conditioned, i.e., the smallest eigenvalue is
+ * repeated or the eigenvector is not determined, have value[i] set to NaN.
+ * So do non-finite inputs.
+ *
+ * Matrices are assumed positive semidefinite, e.g., covariances, so the
+ * eigenvalue is clamped at zero to absorb rounding for planar neighborhoods.
+ */
+inline void smallest_eigenpairs(Index n,
+                                const Value* __restrict a00, const Value* __restrict a01,
+                                const Value* __restrict a02, const Value* __restrict a11,
+                                const Value* __restrict a12, const Value* __restrict a22,
+                                Value* __restrict value,
+                                Value* __restrict x, Value* __restrict y, Value* __restrict z)
+{
+    #pragma omp parallel for simd schedule(static)
+    for (Index i = 0; i < n; ++i)
+    {
+        // Single precision loses too much for the smallest eigenvalue of flat
+        // neighborhoods, double lanes still vectorize.
+        typedef double Real;
+        const Real shift = (Real(a00[i]) + a11[i] + a22[i]) / 3;
+        Real b00 = a00[i] - shift;
+        Real b11 = a11[i] - shift;
+        Real b22 = a22[i] - shift;
+        const Real scale = simd_max(simd_max(simd_max(std::abs(b00), std::abs(b11)), simd_max(std::abs(b22), std::abs(Real(a01[i])))),
+                                    simd_max(std::abs(Real(a02[i])), std::abs(Real(a12[i]))));
+        const Real inv_scale = scale > 0 ? 1 / scale : Real(0);
+        b00 *= inv_scale;
+        b11 *= inv_scale;
+        b22 *= inv_scale;
+        const Real b01 = a01[i] * inv_scale;
+        const Real b02 = a02[i] * inv_scale;
+        const Real b12 = a12[i] * inv_scale;
+
+        // Eigenvalues of B are 2 p cos(phi + 2 k pi / 3), k = 0, 1, 2,
+        // with cos(3 phi) = det(B / p) / 2.
+        const Real off = b01 * b01 + b02 * b02 + b12 * b12;
+        const Real p2 = (b00 * b00 + b11 * b11 + b22 * b22 + 2 * off) / 6;
+        const Real p = std::sqrt(p2);
+        const Real det = b00 * (b11 * b22 - b12 * b12)
+                         - b01 * (b01 * b22 - b12 * b02)
+                         + b02 * (b01 * b12 - b11 * b02);
+        Real r = p > 0 ? det / (2 * p2 * p) : Real(0);
+        r = simd_min(simd_max(r, Real(-1)), Real(1));
+        const Real phi = fast_acos(r) / 3;
+        Real lambda = 2 * p * fast_cos(phi + Real(2 * M_PI / 3));
+        // Refine with a Newton step on det(lambda I - B) = lambda^3 - 3 p2 lambda - det,
+        // trigonometric evaluation loses relative precision near zero.
+        // Large steps only occur near repeated roots where Newton is unreliable.
+        const Real f = (lambda * lambda - 3 * p2) * lambda - det;
+        const Real df = 3 * (lambda * lambda - p2);
+        const Real step = df != 0 ? f / df : Real(0);
+        lambda -= std::abs(step) <= Real(1e-3) * p ? step : Real(0);
+        const Real value_i = simd_max(shift + scale * lambda, Real(0));
+
+        // Eigenvector from cross products of rows of B - lambda I.
+        const Real c00 = b00 - lambda;
+        const Real c11 = b11 - lambda;
+        const Real c22 = b22 - lambda;
+        // r0 x r1
+        const Real x0 = b01 * b12 - b02 * c11;
+        const Real y0 = b02 * b01 - c00 * b12;
+        const Real z0 = c00 * c11 - b01 * b01;
+        // r0 x r2
+        const Real x1 = b01 * c22 - b02 * b12;
+        const Real y1 = b02 * b02 - c00 * c22;
+        const Real z1 = c00 * b12 - b01 * b02;
+        // r1 x r2
+        const Real x2 = c11 * c22 - b12 * b12;
+        const Real y2 = b12 * b02 - b01 * c22;
+        const Real z2 = b01 * b12 - c11 * b02;
+        const Real n0 = x0 * x0 + y0 * y0 + z0 * z0;
+        const Real n1 = x1 * x1 + y1 * y1 + z1 * z1;
+        const Real n2 = x2 * x2 + y2 * y2 + z2 * z2;
+        const bool use_1 = n1 > n0;
+        Real xm = use_1 ? x1 : x0;
+        Real ym = use_1 ? y1 : y0;
+        Real zm = use_1 ? z1 : z0;
+        Real nm = use_1 ? n1 : n0;
+        const bool use_2 = n2 > nm;
+        xm = use_2 ? x2 : xm;
+        ym = use_2 ? y2 : ym;
+        zm = use_2 ? z2 : zm;
+        nm = use_2 ? n2 : nm;
+        const Real inv_norm = nm > 0 ? 1 / std::sqrt(nm) : Real(0);
+        // Zero matrix (scalar multiple of identity) has any unit eigenvector.
+        x[i] = Value(scale > 0 ? xm * inv_norm : Real(1));
+        y[i] = Value(ym * inv_norm);
+        z[i] = Value(zm * inv_norm);
+        // Rows span a plane for a simple eigenvalue, so the largest cross
+        // product of the normalized rows stays well away from zero.
+        // The flag travels in the eigenvalue, narrowing a double comparison
+        // to a byte store does not vectorize without AVX.
+        const bool valid = nm > Real(1e-6) || scale == 0;
+        value[i] = Value(valid ? value_i : std::numeric_limits<Real>::quiet_NaN());
+    }
+}
+
+/**
+ * Batch of smallest eigenpairs of symmetric 3x3 matrices.
+ *
+ * Matrices are stored in structure-of-arrays layout so that the closed-form
+ * solver runs vectorized across points. Ill-conditioned matrices, such as
+ * those with repeated smallest eigenvalue, are solved with Eigen instead.
+ * Eigenvalues are clamped at zero in both cases.
+ */
+class SmallestEigenpairs
+{
+public:
+    size_t size() const
+    {
+        return a00_.size();
+    }
+
+    void resize(size_t n)
+    {
+        a00_.resize(n);
+        a01_.resize(n);
+        a02_.resize(n);
+        a11_.resize(n);
+        a12_.resize(n);
+        a22_.resize(n);
+        value_.resize(n);
+        x_.resize(n);
+        y_.resize(n);
+        z_.resize(n);
+    }
+
+    void set(size_t i, const Mat3& a)
+    {
+        a00_[i] = a(0, 0);
+        a01_[i] = a(0, 1);
+        a02_[i] = a(0, 2);
+        a11_[i] = a(1, 1);
+        a12_[i] = a(1, 2);
+        a22_[i] = a(2, 2);
+    }
+
+    Mat3 matrix(size_t i) const
+    {
+        Mat3 a;
+        a << a00_[i], a01_[i], a02_[i],
+             a01_[i], a11_[i], a12_[i],
+             a02_[i], a12_[i], a22_[i];
+        return a;
+    }
+
+    void compute()
+    {
+        const Index n = Index(size());
+        smallest_eigenpairs(n, a00_.data(), a01_.data(), a02_.data(), a11_.data(), a12_.data(), a22_.data(),
+                            value_.data(), x_.data(), y_.data(), z_.data());
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (Index i = 0; i < n; ++i)
+        {
+            if (!std::isnan(value_[i]))
+            {
+                continue;
+            }
+            Eigen::SelfAdjointEigenSolver<Mat3> solver(matrix(i));
+            value_[i] = std::max(solver.eigenvalues()(0), Value(0));
+            x_[i] = solver.eigenvectors()(0, 0);
+            y_[i] = solver.eigenvectors()(1, 0);
+            z_[i] = solver.eigenvectors()(2, 0);
+        }
+    }
+
+    Value eigenvalue(size_t i) const
+    {
+        return value_[i];
+    }
+
+    Vec3 eigenvector(size_t i) const
+    {
+        return Vec3(x_[i], y_[i], z_[i]);
+    }
+
+    // Upper triangles of input matrices.
+    std::vector<Value> a00_{};
+    std::vector<Value> a01_{};
+    std::vector<Value> a02_{};
+    std::vector<Value> a11_{};
+    std::vector<Value> a12_{};
+    std::vector<Value> a22_{};
+    // Smallest eigenvalues and corresponding unit eigenvectors.
+    std::vector<Value> value_{};
+    std::vector<Value> x_{};
+    std::vector<Value> y_{};
+    std::vector<Value> z_{};
+};
+
+}  // namespace naex
+
+#endif  // NAEX_SYMMETRIC_EIGEN_H
@@ -5,6 +5,7 @@
 #include <naex/clouds.h>
 #include <naex/flann.h>
 #include <naex/nearest_neighbors.h>
+#include <naex/symmetric_eigen.h>
 #include <naex/transforms.h>
 #include <sensor_msgs/point_cloud2_iterator.h>
 #include <sensor_msgs/PointCloud2.h>
@@ -113,18 +114,13 @@ void compute_traversability(const sensor_msgs::PointCloud2 & input,
         }
     }
 
-    // Second pass: estimate normal, inclination, and clearance.
+    // Second pass: estimate covariances, solve for normals in a batch.
+    SmallestEigenpairs eigen;
+    eigen.resize(position_in.rows);
     for (size_t i = 0; i < position_in.rows; ++i)
     {
         if (support[i][0] < min_support)
-        {
-            std::fill(normal[i], normal[i] + 3, std::numeric_limits<float>::quiet_NaN());
-            inclination[i][0] = std::numeric_limits<float>::quiet_NaN();
-            normal_std[i][0] = std::numeric_limits<float>::quiet_NaN();
-            obstacles[i][0] = 0;
-            cost[i][0] = std::numeric_limits<float>::quiet_NaN();
             continue;
-        }
 
         auto & nn = query.nn_[i];
         auto & dist = query.dist_[i];
@@ -149,12 +145,30 @@ void compute_traversability(const sensor_msgs::PointCloud2 & input,
             ++n_cov;
         }
         cov /= (n_cov > 1) ? (n_cov - 1) : 1;
-        Eigen::SelfAdjointEigenSolver<Mat3> solver(cov);
+        eigen.set(i, cov);
+    }
+    eigen.compute();
+
+    // Third pass: inclination and clearance.
+    for (size_t i = 0; i < position_in.rows; ++i)
+    {
+        if (support[i][0] < min_support)
+        {
+            std::fill(normal[i], normal[i] + 3, std::numeric_limits<float>::quiet_NaN());
+            inclination[i][0] = std::numeric_limits<float>::quiet_NaN();
+            normal_std[i][0] = std::numeric_limits<float>::quiet_NaN();
+            obstacles[i][0] = 0;
+            cost[i][0] = std::numeric_limits<float>::quiet_NaN();
+            continue;
+        }
+
+        auto & nn = query.nn_[i];
+        ConstVec3Map c(position[i]);
         Vec3Map n(normal[i]);
-        n = solver.eigenvectors().col(0);
+        n = eigen.eigenvector(i);
         // Use fixed frame for inclination.
         inclination[i][0] = std::acos(std::abs((rotation * n)(2)));
-        normal_std[i][0] = std::sqrt(solver.eigenvalues()(0));
+        normal_std[i][0] = std::sqrt(eigen.eigenvalue(i));
         // Find obstacles in clearance cylinder around upward pointing normal.
         if ((rotation * n)(2) < 0)
             n = -n;
@@ -92,6 +92,16 @@ public:
     Point()
     {}
 
+    Vec3 normal() const
+    {
+        return ConstVec3Map(normal_);
+    }
+    void set_normal(const Vec3& n)
+    {
+        Vec3Map normal(normal_);
+        normal = n;
+    }
+
     Value position_[3] = {std::numeric_limits<Value>::quiet_NaN(),
                           std::numeric_limits<Value>::quiet_NaN(),
                           std::numeric_limits<Value>::quiet_NaN()};
@@ -149,26 +159,22 @@ public:
     Value relative_cost_{std::numeric_limits<Value>::quiet_NaN()};
 };
 
+/** Vertex row of NeighborGraph, edges are stored in shared arrays. */
 class Neighborhood
 {
 public:
     Neighborhood()
     {}
 
+    // Max. number of neighbors from KNN search.
     // TODO: Make K_NEIGHBORS a parameter.
     static const Index K_NEIGHBORS = 48;
-    Value position_[3] = {std::numeric_limits<Value>::quiet_NaN(),
-                          std::numeric_limits<Value>::quiet_NaN(),
-                          std::numeric_limits<Value>::quiet_NaN()};
-    // NN Graph
-    // Number of valid entries in neighbors_ and distances_.
+    // First edge of the vertex in the edge arrays.
+    Edge begin_{0};
+    // Number of valid neighbors, the first one being the vertex itself.
     Index neighbor_count_{0};
-    Index neighbors_[K_NEIGHBORS] = {0};
-    // Treat zero distance and cost as invalid.
-    Value distances_[K_NEIGHBORS] = {0};
-    Value costs_[K_NEIGHBORS] = {0};
-    // Index state from IndexState enum.
-    // uint8_t index_state_;
+    // Number of edge slots reserved for the vertex.
+    Index capacity_{0};
 };
 
 }  // namespace naex
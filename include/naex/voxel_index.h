@@ -0,0 +1,457 @@
+#ifndef NAEX_VOXEL_INDEX_H
+#define NAEX_VOXEL_INDEX_H
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <flann/flann.hpp>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace naex
+{
+
+/**
+ * Incremental spatial index hashing points into voxels.
+ *
+ * Points are inserted and removed in O(1), without any rebuilds, radius
+ * queries visit the voxels overlapping the query ball and KNN queries
+ * expand voxel shells around the query until no closer point can be found.
+ * Point positions are copied, so the index does not depend on the lifetime
+ * of the input matrices.
+ *
+ * The index is thread-safe, queries share a reader lock and run
+ * concurrently, each with its own search context, while insertions and
+ * removals take a writer lock.
+ *
+ * Mimics the subset of flann::Index interface used with Query and
+ * RadiusQuery, indices and distances follow FLANN conventions,
+ * i.e., squared distances and radius, indices never reused, and -1 and
+ * infinity for missing neighbors.
+ *
+ * @tparam T Coordinate type.
+ */
+template<typename T>
+class VoxelIndex
+{
+public:
+    typedef int64_t Coord;
+    typedef uint64_t Key;
+    typedef std::vector<int> Bucket;
+    typedef std::shared_timed_mutex Mutex;
+    typedef std::shared_lock<Mutex> ReadLock;
+    typedef std::unique_lock<Mutex> WriteLock;
+
+    VoxelIndex(T voxel_size):
+        voxel_size_(voxel_size)
+    {
+        assert(voxel_size > 0);
+    }
+
+    VoxelIndex(const flann::Matrix<T>& points, T voxel_size):
+        VoxelIndex(voxel_size)
+    {
+        addPoints(points);
+    }
+
+    /** Kept for compatibility with flann::Index, nothing to build. */
+    void buildIndex()
+    {}
+
+    /** Number of points in the index, excluding removed points. */
+    size_t size() const
+    {
+        ReadLock lock(mutex_);
+        return size_;
+    }
+
+    /** Number of points ever added, including removed points. */
+    size_t num_added() const
+    {
+        ReadLock lock(mutex_);
+        return removed_.size();
+    }
+
+    size_t veclen() const
+    {
+        return 3;
+    }
+
+    T voxel_size() const
+    {
+        return voxel_size_;
+    }
+
+    /** Append points, indices continue from the last added point. */
+    void addPoints(const flann::Matrix<T>& points, float rebuild_threshold = 2.f)
+    {
+        (void) rebuild_threshold;
+        assert(points.cols >= 3);
+        WriteLock lock(mutex_);
+        points_.reserve(points_.size() + 3 * points.rows);
+        for (size_t i = 0; i < points.rows; ++i)
+        {
+            const int index = int(points_.size() / 3);
+            points_.insert(points_.end(), points[i], points[i] + 3);
+            if (!finite(points[i]))
+            {
+                removed_.push_back(true);
+                continue;
+            }
+            voxels_[key(points[i])].push_back(index);
+            removed_.push_back(false);
+            ++size_;
+        }
+    }
+
+    void removePoint(size_t index)
+    {
+        WriteLock lock(mutex_);
+        if (index >= removed_.size() || removed_[index])
+        {
+            return;
+        }
+        const auto it = voxels_.find(key(&points_[3 * index]));
+        assert(it != voxels_.end());
+        auto& bucket = it->second;
+        const auto pos = std::find(bucket.begin(), bucket.end(), int(index));
+        assert(pos != bucket.end());
+        *pos = bucket.back();
+        bucket.pop_back();
+        if (bucket.empty())
+        {
+            voxels_.erase(it);
+        }
+        removed_[index] = true;
+        --size_;
+    }
+
+    int knnSearch(const flann::Matrix<T>& queries,
+                  flann::Matrix<int>& indices,
+                  flann::Matrix<T>& dists,
+                  size_t knn,
+                  const flann::SearchParams& params) const
+    {
+        (void) params;
+        assert(indices.cols >= knn);
+        assert(dists.cols >= knn);
+        ReadLock lock(mutex_);
+        int n = 0;
+        Heap heap;
+        for (size_t i = 0; i < queries.rows; ++i)
+        {
+            knn_search(queries[i], knn, heap);
+            n += write(heap, indices[i], dists[i], indices.cols);
+        }
+        return n;
+    }
+
+    /** Radius search with at most indices.cols neighbors per query. */
+    int radiusSearch(const flann::Matrix<T>& queries,
+                     flann::Matrix<int>& indices,
+                     flann::Matrix<T>& dists,
+                     float radius,
+                     const flann::SearchParams& params) const
+    {
+        const size_t max_neighbors = max_results(params, indices.cols);
+        ReadLock lock(mutex_);
+        int n = 0;
+        Heap heap;
+        for (size_t i = 0; i < queries.rows; ++i)
+        {
+            radius_search(queries[i], radius, max_neighbors, heap);
+            n += write(heap, indices[i], dists[i], indices.cols);
+        }
+        return n;
+    }
+
+    int radiusSearch(const flann::Matrix<T>& queries,
+                     std::vector<std::vector<int>>& indices,
+                     std::vector<std::vector<T>>& dists,
+                     float radius,
+                     const flann::SearchParams& params) const
+    {
+        const size_t max_neighbors = max_results(params, std::numeric_limits<size_t>::max());
+        indices.resize(queries.rows);
+        dists.resize(queries.rows);
+        ReadLock lock(mutex_);
+        int n = 0;
+        Heap heap;
+        for (size_t i = 0; i < queries.rows; ++i)
+        {
+            radius_search(queries[i], radius, max_neighbors, heap);
+            indices[i].resize(heap.size());
+            dists[i].resize(heap.size());
+            n += write(heap, indices[i].data(), dists[i].data(), heap.size());
+        }
+        return n;
+    }
+
+    /**
+     * Visit non-empty voxels overlapping the ball around x, under the reader
+     * lock, e.g., to cull whole voxels before testing their points.
+     * @param radius Ball radius, not squared.
+     * @param visit Called with the minimum voxel corner and point indices.
+     */
+    template<typename F>
+    void visit_voxels(const T* x, T radius, F visit) const
+    {
+        ReadLock lock(mutex_);
+        if (!finite(x))
+        {
+            return;
+        }
+        const Coord x0 = coord(x[0] - radius), x1 = coord(x[0] + radius);
+        const Coord y0 = coord(x[1] - radius), y1 = coord(x[1] + radius);
+        const Coord z0 = coord(x[2] - radius), z1 = coord(x[2] + radius);
+        const double n_voxels = double(x1 - x0 + 1) * double(y1 - y0 + 1) * double(z1 - z0 + 1);
+        T corner[3];
+        // Scan occupied voxels instead if the ball covers more.
+        if (n_voxels > double(voxels_.size()))
+        {
+            for (const auto& voxel: voxels_)
+            {
+                const auto c = coords(voxel.first);
+                if (c[0] < x0 || c[0] > x1 || c[1] < y0 || c[1] > y1 || c[2] < z0 || c[2] > z1)
+                {
+                    continue;
+                }
+                corner[0] = c[0] * voxel_size_;
+                corner[1] = c[1] * voxel_size_;
+                corner[2] = c[2] * voxel_size_;
+                visit(corner, voxel.second);
+            }
+            return;
+        }
+        for (Coord cx = x0; cx <= x1; ++cx)
+        {
+            for (Coord cy = y0; cy <= y1; ++cy)
+            {
+                for (Coord cz = z0; cz <= z1; ++cz)
+                {
+                    const auto it = voxels_.find(key(cx, cy, cz));
+                    if (it == voxels_.end())
+                    {
+                        continue;
+                    }
+                    corner[0] = cx * voxel_size_;
+                    corner[1] = cy * voxel_size_;
+                    corner[2] = cz * voxel_size_;
+                    visit(corner, it->second);
+                }
+            }
+        }
+    }
+
+private:
+    typedef std::pair<T, int> Neighbor;
+    typedef std::priority_queue<Neighbor> Heap;
+
+    static bool finite(const T* x)
+    {
+        return std::isfinite(x[0]) && std::isfinite(x[1]) && std::isfinite(x[2]);
+    }
+
+    static size_t max_results(const flann::SearchParams& params, size_t n)
+    {
+        return params.max_neighbors > 0 ? std::min(size_t(params.max_neighbors), n) : n;
+    }
+
+    Coord coord(T x) const
+    {
+        return Coord(std::floor(x / voxel_size_));
+    }
+
+    static Key key(Coord x, Coord y, Coord z)
+    {
+        // 21 bits per coordinate.
+        const Coord mask = (Coord(1) << 21) - 1;
+        return (Key(x & mask) << 42) | (Key(y & mask) << 21) | Key(z & mask);
+    }
+
+    /** Voxel coordinates from key, sign-extended from 21 bits. */
+    static std::array<Coord, 3> coords(Key key)
+    {
+        const Coord mask = (Coord(1) << 21) - 1;
+        const Coord sign = Coord(1) << 20;
+        std::array<Coord, 3> c;
+        for (int i = 0; i < 3; ++i)
+        {
+            const Coord v = Coord(key >> (42 - 21 * i)) & mask;
+            c[i] = (v ^ sign) - sign;
+        }
+        return c;
+    }
+
+    Key key(const T* x) const
+    {
+        return key(coord(x[0]), coord(x[1]), coord(x[2]));
+    }
+
+    T distance_2(const T* x, int index) const
+    {
+        const T* y = &points_[3 * index];
+        return (x[0] - y[0]) * (x[0] - y[0]) + (x[1] - y[1]) * (x[1] - y[1]) + (x[2] - y[2]) * (x[2] - y[2]);
+    }
+
+    /** Push points from the bucket within radius into a bounded heap. */
+    void collect(const T* x, const Bucket& bucket, T radius_2, size_t k, Heap& heap) const
+    {
+        for (const auto index: bucket)
+        {
+            const T d = distance_2(x, index);
+            if (d > radius_2)
+            {
+                continue;
+            }
+            if (heap.size() < k)
+            {
+                heap.emplace(d, index);
+            }
+            else if (d < heap.top().first)
+            {
+                heap.pop();
+                heap.emplace(d, index);
+            }
+        }
+    }
+
+    /** Collect points from voxel at given coordinates. */
+    bool collect(const T* x, Coord cx, Coord cy, Coord cz, T radius_2, size_t k, Heap& heap) const
+    {
+        const auto it = voxels_.find(key(cx, cy, cz));
+        if (it == voxels_.end())
+        {
+            return false;
+        }
+        collect(x, it->second, radius_2, k, heap);
+        return true;
+    }
+
+    /** Collect points from all voxels. */
+    void scan(const T* x, T radius_2, size_t k, Heap& heap) const
+    {
+        for (const auto& voxel: voxels_)
+        {
+            collect(x, voxel.second, radius_2, k, heap);
+        }
+    }
+
+    void radius_search(const T* x, float radius_2, size_t k, Heap& heap) const
+    {
+        heap = Heap();
+        if (k == 0 || !finite(x))
+        {
+            return;
+        }
+        const T radius = std::sqrt(T(radius_2));
+        const Coord x0 = coord(x[0] - radius), x1 = coord(x[0] + radius);
+        const Coord y0 = coord(x[1] - radius), y1 = coord(x[1] + radius);
+        const Coord z0 = coord(x[2] - radius), z1 = coord(x[2] + radius);
+        const double n_voxels = double(x1 - x0 + 1) * double(y1 - y0 + 1) * double(z1 - z0 + 1);
+        // Scan occupied voxels instead if the ball covers more.
+        if (n_voxels > double(voxels_.size()))
+        {
+            scan(x, T(radius_2), k, heap);
+            return;
+        }
+        for (Coord cx = x0; cx <= x1; ++cx)
+        {
+            for (Coord cy = y0; cy <= y1; ++cy)
+            {
+                for (Coord cz = z0; cz <= z1; ++cz)
+                {
+                    collect(x, cx, cy, cz, T(radius_2), k, heap);
+                }
+            }
+        }
+    }
+
+    void knn_search(const T* x, size_t k, Heap& heap) const
+    {
+        heap = Heap();
+        if (k == 0 || size_ == 0 || !finite(x))
+        {
+            return;
+        }
+        const T inf = std::numeric_limits<T>::infinity();
+        const Coord cx = coord(x[0]);
+        const Coord cy = coord(x[1]);
+        const Coord cz = coord(x[2]);
+        size_t n_visited = 0;
+        // Expand shells of voxels at Chebyshev distance r from the query
+        // voxel. Points outside shell r are farther than r voxels.
+        for (Coord r = 0; ; ++r)
+        {
+            // Scan occupied voxels instead if the shells cover more.
+            if (double(2 * r + 1) * double(2 * r + 1) * double(2 * r + 1) > 8. * double(voxels_.size()))
+            {
+                heap = Heap();
+                scan(x, inf, k, heap);
+                return;
+            }
+            for (Coord dx = -r; dx <= r; ++dx)
+            {
+                for (Coord dy = -r; dy <= r; ++dy)
+                {
+                    const bool face = (std::abs(dx) == r || std::abs(dy) == r);
+                    const Coord step = face ? 1 : 2 * r;
+                    for (Coord dz = -r; dz <= r; dz += std::max(step, Coord(1)))
+                    {
+                        if (collect(x, cx + dx, cy + dy, cz + dz, inf, k, heap))
+                        {
+                            ++n_visited;
+                        }
+                    }
+                }
+            }
+            const T reach = r * voxel_size_;
+            if (heap.size() >= std::min(k, size_) && heap.top().first <= reach * reach)
+            {
+                return;
+            }
+            // All occupied voxels visited, no more points to find.
+            if (n_visited >= voxels_.size())
+            {
+                return;
+            }
+        }
+    }
+
+    /** Write heap contents in ascending distance, pad to n with invalid values. */
+    static int write(Heap& heap, int* indices, T* dists, size_t n)
+    {
+        const int found = int(heap.size());
+        for (int i = found - 1; i >= 0; --i)
+        {
+            indices[i] = heap.top().second;
+            dists[i] = heap.top().first;
+            heap.pop();
+        }
+        for (size_t i = size_t(found); i < n; ++i)
+        {
+            indices[i] = -1;
+            dists[i] = std::numeric_limits<T>::infinity();
+        }
+        return found;
+    }
+
+    mutable Mutex mutex_;
+    T voxel_size_;
+    // Positions of all added points, including removed ones.
+    std::vector<T> points_{};
+    std::vector<bool> removed_{};
+    std::unordered_map<Key, Bucket> voxels_{};
+    size_t size_{0};
+};
+
+}  // namespace naex
+
+#endif  // NAEX_VOXEL_INDEX_H
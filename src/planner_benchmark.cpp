@@ -0,0 +1,126 @@
+#include <naex/delta_stepping.h>
+#include <naex/exceptions.h>
+#include <naex/graph.h>
+#include <naex/map.h>
+#include <naex/radix_heap.h>
+#include <naex/search_workspace.h>
+#include <naex/shortest_paths.h>
+#include <naex/timer.h>
+#include <cstdlib>
+#include <iostream>
+#include <omp.h>
+#include <random>
+// Summary:
+// Compares single-source shortest paths over a synthetic terrain map using
+// boost::dijkstra_shortest_paths_no_color_map, and the planner search with
+// binary and radix heaps, and parallel delta-stepping.
+// Usage: planner_benchmark [grid size] [repetitions] [delta]
+
+using namespace naex;
+
+namespace
+{
+    /** Rolling terrain on a jittered grid with given spacing. */
+    std::vector<Value> terrain(int size, Value spacing)
+    {
+        std::mt19937 gen(0);
+        std::uniform_real_distribution<Value> jitter(-spacing / 4, spacing / 4);
+        std::vector<Value> points;
+        points.reserve(3 * size * size);
+        for (int i = 0; i < size; ++i)
+        {
+            for (int j = 0; j < size; ++j)
+            {
+                const Value x = i * spacing + jitter(gen);
+                const Value y = j * spacing + jitter(gen);
+                points.push_back(x);
+                points.push_back(y);
+                points.push_back(Value(0.5) * std::sin(x / 5) * std::cos(y / 7) + jitter(gen) / 4);
+            }
+        }
+        return points;
+    }
+
+    size_t count_mismatches(const std::vector<Value>& expected, const SearchWorkspace& actual)
+    {
+        size_t n = 0;
+        for (size_t v = 0; v < expected.size(); ++v)
+        {
+            const Value cost = actual.path_cost(Vertex(v));
+            if (!(expected[v] == cost) && !(std::isinf(expected[v]) && std::isinf(cost)))
+            {
+                ++n;
+            }
+        }
+        return n;
+    }
+
+    template<typename Q>
+    void benchmark_planner(const Map& map, Vertex source, int repetitions,
+                           const std::vector<Value>& expected, SearchWorkspace& workspace,
+                           const char* name)
+    {
+        IncrementalShortestPathsT<Q> paths(workspace);
+        Timer t;
+        for (int i = 0; i < repetitions; ++i)
+        {
+            paths.compute(map, source);
+        }
+        std::cout << name << ": " << t.seconds_elapsed() / repetitions << " s, "
+                  << count_mismatches(expected, workspace) << " mismatches" << std::endl;
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    const int size = argc > 1 ? std::atoi(argv[1]) : 1000;
+    const int repetitions = argc > 2 ? std::atoi(argv[2]) : 5;
+    const Value delta = argc > 3 ? Value(std::atof(argv[3])) : Value(0.5);
+
+    Map map;
+    map.points_min_dist_ = 0.1f;
+    map.neighborhood_radius_ = 0.3f;
+    map.clearance_radius_ = 0.3f;
+    auto points = terrain(size, 0.12f);
+    Value origin_buf[3] = {0, 0, 10};
+    flann::Matrix<Value> positions(points.data(), points.size() / 3, 3);
+    flann::Matrix<Value> origin(origin_buf, 1, 3);
+    Timer t;
+    map.initialize(positions, origin);
+    map.update_dirty();
+    map.clear_dirty();
+    std::cout << "Map with " << map.num_vertices() << " vertices and " << map.num_edges()
+              << " edges built (" << t.seconds_elapsed() << " s)." << std::endl;
+
+    const Vertex source = Vertex(map.num_vertices() / 2);
+    Graph g(map);
+    EdgeCosts edge_costs(map);
+    boost::typed_identity_property_map<Vertex> index_map;
+    std::vector<Vertex> predecessor(size_t(map.num_vertices()));
+    std::vector<Value> path_costs(size_t(map.num_vertices()));
+    t.reset();
+    for (int i = 0; i < repetitions; ++i)
+    {
+        boost::dijkstra_shortest_paths_no_color_map(g, source,
+                                                    predecessor.data(), path_costs.data(), edge_costs,
+                                                    index_map,
+                                                    std::less<Value>(), boost::closed_plus<Value>(),
+                                                    std::numeric_limits<Value>::infinity(), Value(0.),
+                                                    boost::dijkstra_visitor<boost::null_visitor>());
+    }
+    std::cout << "Boost Dijkstra: " << t.seconds_elapsed() / repetitions << " s" << std::endl;
+
+    SearchWorkspace workspace;
+    benchmark_planner<BinaryHeap<Vertex>>(map, source, repetitions, path_costs, workspace, "Binary heap");
+    benchmark_planner<RadixHeap<Vertex>>(map, source, repetitions, path_costs, workspace, "Radix heap");
+
+    DeltaStepping delta_stepping(workspace);
+    t.reset();
+    for (int i = 0; i < repetitions; ++i)
+    {
+        delta_stepping.compute(map, source, delta);
+    }
+    std::cout << "Delta-stepping (delta " << delta << ", " << omp_get_max_threads() << " threads): "
+              << t.seconds_elapsed() / repetitions << " s, "
+              << count_mismatches(path_costs, workspace) << " mismatches" << std::endl;
+}